@@ -1,3 +1,5 @@
+#pragma once
+
 #define FontLocation "/home/kenniblank/Other/Programming/scratch-pad/fonts/ComingSoon_bold.ttf"
 
 #ifdef RELEASE
@@ -13,6 +15,57 @@
 #define RENDER_WINDOW_WIDTH 3840
 #define RENDER_WINDOW_HEIGHT 2160
 
+#define EXPORT_SEQUENCE_FILE ".export_sequence" // Next free image index, kept inside FOLDER
+#define EXPORT_POOL_SIZE 3 // Frames that can wait for PNG encoding at once
+#define EXPORT_BAND_HEIGHT 128 // Rows rasterized at once by full canvas export
+#define EXPORT_TILE_SIZE 256 // Columns per tile of a band, the unit of parallel work
+#define VECTOR_BUFFER_SIZE (1 << 16) // Bytes buffered by SVG/PDF export before each write
+#define VECTOR_SIZE_FIELD 80 // Room reserved in the SVG header for its size, patched at the end
+#define CSV_BUFFER_SIZE (1 << 20) // Bytes buffered by CSV export before each write
+#define CSV_MIN_CHUNK (4 << 20) // Smallest slice of a CSV file worth its own import thread
+#define CSV_MAX_CHUNKS 64
+#define EXPORT_MAX_SIZE 32768 // Largest side of an exported canvas (PNG limit is 2^31)
+
+#define DOCUMENT_GARBAGE_RATIO 0.5 // Share of a .scratch file that may be dead before it's compacted
+#define DOCUMENT_COMPACT_MIN (1 << 20) // Smaller files aren't worth compacting
+
+#define JOURNAL_FLUSH_MS 50 // Crash recovery journal is synced at least this often...
+#define JOURNAL_FLUSH_BYTES (16 << 10) // ...or as soon as this much is pending
+#define JOURNAL_FILE "session.journal" // Inside SDL_GetPrefPath
+#define JOURNAL_UNRECOVERED ".unrecovered" // Suffix of a crashed session's journal of another board
+#define JOURNAL_PATH_MAX 1024 // Longest board path recorded in the journal
+#define RENDER_QUEUE_SIZE 256 // Commands in flight to the render thread, power of two
+#define INPUT_IDLE_WAIT 100 // ms the event thread sleeps without input
+#define MOTION_BATCH 256 // Mouse motion events ingested per batch
+#define JOB_MAX_WORKERS 64 // Job workers, one per core up to this
+#define JOB_DEPENDENTS 8 // Jobs that can wait on one job
+#define SCHEDULER_TASKS 16 // Timers and idle tasks on the event thread
+#define CARET_BLINK_MS 700
+#define GOVERNOR_IDLE_MS 500 // Longest the render thread sleeps between commands when nothing is drawn
+#define GOVERNOR_HISTORY 8 // Present mode transitions kept for the stats
+#define GOVERNOR_FRAME_BUCKETS 500 // Frame time histogram...
+#define GOVERNOR_FRAME_BUCKET_MS 0.1 // ...in steps of this, up to 50 ms
+#define RENDER_BUDGET_MS 4 // Longest a frame spends redrawing the board...
+#define FRAME_BUDGET_SHARE 0.5 // ...or this share of the frame, if that is less
+#define PROGRESSIVE_RING 64 // px: large redraws fill in outward from the window centre in rings this wide
+#define SEGMENT_COST_NS 1000 // Assumed cost of one anti aliased segment until it has been measured
+#define PREVIEW_COST_NS 50 // Same for one segment of the cheap pass
+#define PREVIEW_BATCH 128 // Segments of the live stroke preview per draw call
+#define LATCH_MARGIN_MS 3 // Low latency inking samples the pointer this long before the expected vblank
+#define PREDICT_SAMPLES 8 // Pointer samples the motion predictor fits
+#define PREDICT_WINDOW_MS 60 // Older samples don't describe the current motion
+#define PREDICT_FRAMES 1.5 // How far ahead the predicted tip is drawn
+#define PREDICT_MAX_DISTANCE 48 // px past the newest sample
+#define BENCH_POINTS_PER_FRAME 8 // make bench: points ingested between frames (~500 Hz input at 60 Hz)
+#define BENCH_REPEAT 50 // Times a trace is replayed, short traces alone don't measure much
+#define MICROBENCH_MIN_MS 20 // make microbench: each kernel and line shape runs at least this long
+#define MICROBENCH_MAX_LENGTH 512 // Longest line swept, px
+#define WORKLOAD_MAX_THICKNESSES 32 // make workload: entries in --thickness
+#define WORKLOAD_CLUSTERS 8 // Centres of --distribution clustered
+#define RECORDER_BUFFER (64 << 10) // Recorded input is written in blocks this big
+#define REPLAY_BACKLOG 512 // Events a fast replay queues ahead of the event loop
+#define WARM_CACHE_FILE "warm.scratch" // Board and last frame of the previous session, also inside SDL_GetPrefPath
+
 #define FONT_SIZE 16
 #define POINTS_THRESHOLD 1 // In pixel: basically how much gap minimum should be between points minimum
 
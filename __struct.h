@@ -1,5 +1,13 @@
+#pragma once
+
 // Structure to store point
 typedef struct {
     long long int x, y, line_thickness;
     bool connect;
 } Point;
+
+// A run of connected points, the unit the renderer culls by
+typedef struct {
+    size_t first, count; // points[first .. first + count)
+    long long min_x, min_y, max_x, max_y; // Bounding box including line thickness
+} Stroke;
@@ -0,0 +1,135 @@
+// Headless benchmark: replays point traces through addPoint and the renderer on
+// SDL's dummy video driver with the software renderer, and prints JSON.
+//
+//   make bench
+//   ./scratch_bench [--repeat N] [trace.csv ...]
+//
+// Each frame ingests BENCH_POINTS_PER_FRAME points and draws the board the way
+// the render thread does. After the replay the board is redrawn once at full
+// quality, as after a dark mode toggle.
+
+#define SCRATCH_BENCH
+#include "main.c"
+
+static int compare_ms(const void* a, const void* b) {
+    double x = *(const double*) a, y = *(const double*) b;
+    return (x > y) - (x < y);
+}
+
+static double percentile(const double* sorted, size_t count, double p) {
+    if (count == 0) return 0;
+    size_t i = (size_t) (p * (count - 1) + 0.5);
+    return sorted[i];
+}
+
+static double seconds_since(Uint64 start) {
+    return (double) (SDL_GetPerformanceCounter() - start) / SDL_GetPerformanceFrequency();
+}
+
+static bool bench_trace(SDL_Renderer* renderer, const char* path, int repeat, bool first) {
+    size_t count;
+    Point* trace = ImportCSV(path, &count);
+    if (!trace) return false;
+
+    size_t total = count * repeat;
+    size_t frame_count = total / BENCH_POINTS_PER_FRAME + 1;
+    double* frames = malloc(frame_count * sizeof(double));
+    if (!frames) {
+        fprintf(stderr, "Memory allocation failed!\n");
+        exit(1);
+    }
+
+    clearPoints();
+    RetainedCanvas canvas = {0};
+    double ingest_s = 0;
+    size_t frame = 0;
+    for (size_t done = 0; done < total; frame++) {
+        Uint64 start = SDL_GetPerformanceCounter();
+        for (size_t end = done + BENCH_POINTS_PER_FRAME; done < end && done < total; done++) {
+            const Point* p = &trace[done % count];
+            addPoint(p -> x, p -> y, p -> line_thickness, p -> connect);
+        }
+        ingest_s += seconds_since(start);
+
+        RenderView view = {.snapshot = snapshotBoard(), .board = board_generation};
+        RenderBoard(renderer, &canvas, &view, false);
+        SDL_RenderPresent(renderer);
+        snapshot_release(view.snapshot);
+        frames[frame] = seconds_since(start) * 1000;
+    }
+
+    // Full quality redraw of everything, nothing retained
+    RenderView view = {.snapshot = snapshotBoard(), .board = board_generation};
+    int width, height;
+    SDL_GetRendererOutputSize(renderer, &width, &height);
+    Uint64 start = SDL_GetPerformanceCounter();
+    SDL_SetRenderDrawColor(renderer, unpack_color(background_color));
+    SDL_RenderClear(renderer);
+    size_t segments = RenderStrokes(renderer, view.snapshot, NULL, 0, view.snapshot -> stroke_count, width, height, false);
+    SDL_RenderPresent(renderer);
+    double redraw_s = seconds_since(start);
+    snapshot_release(view.snapshot);
+
+    qsort(frames, frame, sizeof(double), compare_ms);
+    printf("%s  {\"trace\": \"%s\", \"repeat\": %d, \"points\": %zu, \"stored_points\": %zu, \"frames\": %zu,\n", first ? "" : ",\n", path, repeat, total, pointCount, frame);
+    printf("   \"points_per_s\": %.0f, \"segments\": %zu, \"segments_per_s\": %.0f, \"redraw_ms\": %.3f,\n",
+        ingest_s > 0 ? total / ingest_s : 0, segments, redraw_s > 0 ? segments / redraw_s : 0, redraw_s * 1000);
+    printf("   \"frame_ms\": {\"p50\": %.3f, \"p90\": %.3f, \"p99\": %.3f, \"max\": %.3f}}",
+        percentile(frames, frame, 0.5), percentile(frames, frame, 0.9), percentile(frames, frame, 0.99), frame ? frames[frame - 1] : 0);
+
+    if (canvas.texture) SDL_DestroyTexture(canvas.texture);
+    free(canvas.order);
+    free(frames);
+    free(trace);
+    clearPoints();
+    return true;
+}
+
+int main(int argc, char** argv) {
+    int repeat = BENCH_REPEAT;
+    int first_trace = 1;
+    if (argc > 2 && strcmp(argv[1], "--repeat") == 0) {
+        repeat = atoi(argv[2]) > 0 ? atoi(argv[2]) : 1;
+        first_trace = 3;
+    }
+
+    // Same setup on every machine: no window system, no GPU
+    SDL_setenv("SDL_VIDEODRIVER", "dummy", 0);
+    if (SDL_Init(SDL_INIT_VIDEO) < 0) {
+        printf("SDL could not initialize! SDL_Error: %s\n", SDL_GetError());
+        return 1;
+    }
+    SDL_Window* window = SDL_CreateWindow("Scratch Bench", 0, 0, WINDOW_WIDTH, WINDOW_HEIGHT, SDL_WINDOW_HIDDEN);
+    SDL_Renderer* renderer = window ? SDL_CreateRenderer(window, -1, SDL_RENDERER_SOFTWARE) : NULL;
+    if (!renderer) {
+        printf("Renderer could not be created! SDL_Error: %s\n", SDL_GetError());
+        SDL_Quit();
+        return 1;
+    }
+    SDL_SetRenderDrawBlendMode(renderer, SDL_BLENDMODE_BLEND);
+    text_color = (SDL_Color) {0, 0, 0, 255};
+    background_color = (SDL_Color) {255, 255, 255, 255};
+
+    jobs_init();
+    document_init();
+    governor_init(window, renderer);
+
+    printf("{\"video\": \"%s\", \"renderer\": \"software\", \"width\": %d, \"height\": %d, \"points_per_frame\": %d, \"runs\": [\n",
+        SDL_GetCurrentVideoDriver(), WINDOW_WIDTH, WINDOW_HEIGHT, BENCH_POINTS_PER_FRAME);
+    bool ok = true, first = true;
+    if (first_trace >= argc) {
+        ok = bench_trace(renderer, "Data/Points.csv", repeat, true);
+    }
+    for (int i = first_trace; i < argc; i++) {
+        ok = bench_trace(renderer, argv[i], repeat, first) && ok;
+        first = false;
+    }
+    printf("\n]}\n");
+
+    document_shutdown();
+    jobs_shutdown();
+    SDL_DestroyRenderer(renderer);
+    SDL_DestroyWindow(window);
+    SDL_Quit();
+    return ok ? 0 : 1;
+}
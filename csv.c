@@ -0,0 +1,362 @@
+#include <SDL2/SDL.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "__macros.h"
+#include "csv.h"
+#include "jobs.h"
+#include "export.h"
+
+#define CSV_HEADER "Coordinate, Line Thicknes, Connected\n"
+
+typedef struct {
+    const char *start, *end; // Bytes of this chunk, starting at a line
+    Point* points;           // Its place in the import's one array
+    size_t count, lines;     // lines is an upper bound on count
+    size_t skipped;          // Lines that didn't parse, the header included
+} Chunk;
+
+// One import into a single array: a count job per chunk, then a place job that
+// sizes the array and hands each chunk its offset, a parse job per chunk, and a
+// stitch job that closes the gaps left by lines that weren't points.
+typedef struct {
+    Chunk chunks[CSV_MAX_CHUNKS];
+    int chunk_count;
+    Point* points;
+    size_t total, skipped;
+    bool failed;
+    SDL_sem* stitched;       // Posted once points is ready
+} Import;
+
+static inline const char* skip_spaces(const char* p, const char* end) {
+    while (p < end && (*p == ' ' || *p == '\t' || *p == '\r')) p++;
+    return p;
+}
+
+static inline bool expect(const char** cursor, const char* end, char c) {
+    const char* p = skip_spaces(*cursor, end);
+    if (p >= end || *p != c) return false;
+    *cursor = p + 1;
+    return true;
+}
+
+static inline bool parse_int(const char** cursor, const char* end, long long* value) {
+    const char* p = skip_spaces(*cursor, end);
+    bool negative = p < end && *p == '-';
+    if (negative || (p < end && *p == '+')) p++;
+
+    const char* digits = p;
+    long long result = 0;
+    while (p < end && *p >= '0' && *p <= '9' && p - digits < 18) {
+        result = result * 10 + (*p - '0');
+        p++;
+    }
+    if (p == digits) return false;
+
+    *value = negative ? -result : result;
+    *cursor = p;
+    return true;
+}
+
+// True/False, only the first letter decides, any case
+static inline bool parse_bool(const char** cursor, const char* end, bool* value) {
+    const char* p = skip_spaces(*cursor, end);
+    if (p >= end) return false;
+    if (*p == 'T' || *p == 't' || *p == '1') *value = true;
+    else if (*p == 'F' || *p == 'f' || *p == '0') *value = false;
+    else return false;
+
+    while (p < end && *p != ',' && *p != '\n' && *p != ' ' && *p != '\r') p++;
+    *cursor = p;
+    return true;
+}
+
+static bool parse_line(const char* p, const char* end, Point* point) {
+    return expect(&p, end, '(') && parse_int(&p, end, &point -> x) &&
+        expect(&p, end, ',') && parse_int(&p, end, &point -> y) &&
+        expect(&p, end, ')') && expect(&p, end, ',') && parse_int(&p, end, &point -> line_thickness) &&
+        expect(&p, end, ',') && parse_bool(&p, end, &point -> connect) &&
+        skip_spaces(p, end) == end;
+}
+
+// Same line splitting as parse_chunk, so every point has a slot
+static void count_chunk(void* data) {
+    Chunk* chunk = data;
+    for (const char* p = chunk -> start; p < chunk -> end; chunk -> lines++) {
+        const char* line_end = memchr(p, '\n', chunk -> end - p);
+        p = line_end ? line_end + 1 : chunk -> end;
+    }
+}
+
+static void parse_chunk(void* data) {
+    Chunk* chunk = data;
+    const char* p = chunk -> start;
+
+    while (p < chunk -> end && chunk -> count < chunk -> lines) {
+        const char* line_end = memchr(p, '\n', chunk -> end - p);
+        if (!line_end) line_end = chunk -> end;
+
+        Point* point = &chunk -> points[chunk -> count];
+        memset(point, 0, sizeof(*point));
+        if (parse_line(p, line_end, point)) {
+            chunk -> count++;
+        } else if (skip_spaces(p, line_end) != line_end) {
+            chunk -> skipped++;
+        }
+        p = line_end + 1;
+    }
+}
+
+// Sizes the array for every line and gives each chunk its slice of it
+static bool place_chunks(Import* import) {
+    size_t lines = 0;
+    for (int i = 0; i < import -> chunk_count; i++) {
+        lines += import -> chunks[i].lines;
+    }
+
+    import -> points = malloc((lines ? lines : 1) * sizeof(Point));
+    if (!import -> points) {
+        import -> failed = true;
+        return false;
+    }
+    size_t offset = 0;
+    for (int i = 0; i < import -> chunk_count; i++) {
+        import -> chunks[i].points = import -> points + offset;
+        offset += import -> chunks[i].lines;
+    }
+    return true;
+}
+
+// Chunks move down over the slots of skipped lines, in file order
+static void stitch_job(void* data) {
+    Import* import = data;
+
+    if (!import -> failed) {
+        for (int i = 0; i < import -> chunk_count; i++) {
+            Chunk* chunk = &import -> chunks[i];
+            memmove(import -> points + import -> total, chunk -> points, chunk -> count * sizeof(Point));
+            import -> total += chunk -> count;
+            import -> skipped += chunk -> skipped;
+        }
+
+        // Only shrinks, so failing to just keeps the bigger block
+        Point* trimmed = realloc(import -> points, (import -> total ? import -> total : 1) * sizeof(Point));
+        if (trimmed) import -> points = trimmed;
+    }
+
+    if (import -> stitched) SDL_SemPost(import -> stitched);
+}
+
+// Runs once every chunk is counted
+static void place_job(void* data) {
+    Import* import = data;
+    Job* stitch = job_create("csv stitch", JOB_HIGH, stitch_job, NULL, import);
+    if (!place_chunks(import)) {
+        job_submit(stitch);
+        return;
+    }
+
+    Job* parse[CSV_MAX_CHUNKS];
+    for (int i = 0; i < import -> chunk_count; i++) {
+        parse[i] = job_create("csv import", JOB_HIGH, parse_chunk, NULL, &import -> chunks[i]);
+        job_after(stitch, parse[i]);
+    }
+    for (int i = 0; i < import -> chunk_count; i++) {
+        job_submit(parse[i]);
+    }
+    job_submit(stitch);
+}
+
+Point* ImportCSV(const char* path, size_t* count) {
+    *count = 0;
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        printf("Couldn't open %s: %s\n", path, strerror(errno));
+        return NULL;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        return NULL;
+    }
+    if (st.st_size == 0) {
+        close(fd);
+        return calloc(1, sizeof(Point));
+    }
+
+    const char* data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        printf("Couldn't map %s: %s\n", path, strerror(errno));
+        return NULL;
+    }
+    madvise((void*) data, st.st_size, MADV_SEQUENTIAL);
+    const char* end = data + st.st_size;
+
+    // One chunk per core, but never smaller than CSV_MIN_CHUNK
+    int chunk_count = SDL_GetCPUCount();
+    if ((size_t) st.st_size / CSV_MIN_CHUNK + 1 < (size_t) chunk_count) chunk_count = st.st_size / CSV_MIN_CHUNK + 1;
+    if (chunk_count < 1) chunk_count = 1;
+    if (chunk_count > CSV_MAX_CHUNKS) chunk_count = CSV_MAX_CHUNKS;
+
+    Import* import = calloc(1, sizeof(Import));
+    if (!import) {
+        fprintf(stderr, "Memory allocation failed!\n");
+        exit(1);
+    }
+    Chunk* chunks = import -> chunks;
+    import -> chunk_count = chunk_count;
+
+    // Boundaries move forward to the next line start so no line is split
+    const char* start = data;
+    for (int i = 0; i < chunk_count; i++) {
+        const char* nominal = data + (size_t) st.st_size / chunk_count * (i + 1);
+        const char* boundary = end;
+        if (i + 1 < chunk_count && nominal > start) {
+            const char* newline = memchr(nominal, '\n', end - nominal);
+            boundary = newline ? newline + 1 : end;
+        }
+        if (boundary < start) boundary = start;
+
+        chunks[i].start = start;
+        chunks[i].end = boundary;
+        start = boundary;
+    }
+
+    // Without workers job_submit runs each job in place, in submit order
+    import -> stitched = SDL_CreateSemaphore(0);
+    if (import -> stitched) {
+        Job* place = job_create("csv place", JOB_HIGH, place_job, NULL, import);
+        Job* count_jobs[CSV_MAX_CHUNKS];
+        for (int i = 0; i < chunk_count; i++) {
+            count_jobs[i] = job_create("csv count", JOB_HIGH, count_chunk, NULL, &chunks[i]);
+            job_after(place, count_jobs[i]);
+        }
+        for (int i = 0; i < chunk_count; i++) {
+            job_submit(count_jobs[i]);
+        }
+        job_submit(place);
+        SDL_SemWait(import -> stitched);
+        SDL_DestroySemaphore(import -> stitched);
+    } else {
+        for (int i = 0; i < chunk_count; i++) {
+            count_chunk(&chunks[i]);
+        }
+        if (place_chunks(import)) {
+            for (int i = 0; i < chunk_count; i++) {
+                parse_chunk(&chunks[i]);
+            }
+        }
+        stitch_job(import);
+    }
+    munmap((void*) data, st.st_size);
+
+    Point* points = import -> failed ? NULL : import -> points;
+    size_t total = import -> total, skipped = import -> skipped;
+    free(import);
+
+    if (!points) {
+        fprintf(stderr, "Memory allocation failed!\n");
+        return NULL;
+    }
+    if (skipped > 1) { // The header line is expected
+        printf("%s: skipped %zu lines that aren't points\n", path, skipped - 1);
+    }
+    *count = total;
+    return points;
+}
+
+// Appends "(x, y), thickness, True\n" without printf
+static char* format_point(char* out, const Point* p) {
+    long long values[3] = {p -> x, p -> y, p -> line_thickness};
+    static const char* separators[3] = {", ", "), ", ", "};
+
+    *out++ = '(';
+    for (int v = 0; v < 3; v++) {
+        char digits[24];
+        int n = 0;
+        unsigned long long magnitude = values[v] < 0 ? -(unsigned long long) values[v] : (unsigned long long) values[v];
+        do {
+            digits[n++] = '0' + magnitude % 10;
+            magnitude /= 10;
+        } while (magnitude);
+        if (values[v] < 0) *out++ = '-';
+        while (n) *out++ = digits[--n];
+
+        for (const char* s = separators[v]; *s; s++) *out++ = *s;
+    }
+
+    const char* word = p -> connect ? "True\n" : "False\n";
+    size_t len = p -> connect ? 5 : 6;
+    memcpy(out, word, len);
+    return out + len;
+}
+
+// Header and rows through one buffer, flushed whenever it fills up
+static bool write_points(int fd, const Point* points, size_t count) {
+    char* buffer = malloc(CSV_BUFFER_SIZE);
+    bool saved = buffer != NULL;
+    size_t used = 0;
+
+    if (saved) {
+        memcpy(buffer, CSV_HEADER, sizeof(CSV_HEADER) - 1);
+        used = sizeof(CSV_HEADER) - 1;
+    }
+
+    for (size_t i = 0; saved && i < count; i++) {
+        // A row is at most 3 * 20 digits and signs plus punctuation
+        if (used + 96 > CSV_BUFFER_SIZE) {
+            saved = write_all(fd, buffer, used);
+            used = 0;
+        }
+        used = format_point(buffer + used, &points[i]) - buffer;
+    }
+    if (saved && used) saved = write_all(fd, buffer, used);
+
+    free(buffer);
+    return saved;
+}
+
+bool ExportCSV(const Point* points, size_t count) {
+    char filename[256];
+    int fd = export_reserve("__points__", "csv", filename, sizeof(filename));
+    if (fd < 0) {
+        export_notify(-1, NULL);
+        return false;
+    }
+
+    bool saved = write_points(fd, points, count);
+    if (close(fd) != 0) saved = false;
+
+    if (!saved) {
+        printf("Unable to save points as CSV\n");
+        unlink(filename);
+    }
+    export_notify(saved ? 0 : -1, filename);
+    return saved;
+}
+
+bool SaveCSV(const char* path, const Point* points, size_t count) {
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        printf("Couldn't create %s: %s\n", path, strerror(errno));
+        return false;
+    }
+
+    bool saved = write_points(fd, points, count);
+    if (close(fd) != 0) saved = false;
+    if (!saved) {
+        printf("Unable to save points as CSV\n");
+        unlink(path);
+    }
+    return saved;
+}
@@ -0,0 +1,20 @@
+#ifndef CSV_H
+#define CSV_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "__struct.h"
+
+// Data/Points.csv format: "(x, y), thickness, True/False" per line after a header.
+
+// Maps the file and parses it on every core, one newline aligned chunk per thread.
+// Malformed lines are skipped and counted. Returns malloc'ed points or NULL.
+Point* ImportCSV(const char* path, size_t* count);
+
+// Writes the points to a new file in FOLDER. Reported through EXPORT_EVENT.
+bool ExportCSV(const Point* points, size_t count);
+// Same format at a path of the caller's choosing, synchronously
+bool SaveCSV(const char* path, const Point* points, size_t count);
+
+#endif
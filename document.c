@@ -0,0 +1,575 @@
+#include <SDL2/SDL.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "__macros.h"
+#include "document.h"
+#include "export.h"
+#include "jobs.h"
+
+// What the file on disk holds, so the next save only appends the difference.
+// Shared with the compaction job, guarded by save_lock.
+typedef struct {
+    bool valid; // false: the next save rewrites the whole file
+    char path[1024];
+    off_t file_size;
+
+    ScratchBlock* index;
+    size_t block_count, index_capacity;
+
+    size_t points, strokes; // element counts after replaying the index
+    char* text;             // text after replaying the index
+    size_t text_len;
+    Uint32 board;           // Board generation on disk; another one restarts the delta at the first point
+    Uint64 version;         // Snapshot on disk; background saves can finish out of order
+} SaveState;
+
+static SaveState saved;
+static SDL_mutex* save_lock = NULL;
+static SDL_cond* compacted = NULL; // Broadcast when a compaction job ends
+static bool compacting = false;    // Guarded by save_lock
+
+static size_t element_size(Uint32 type) {
+    switch (type) {
+        case BLOCK_POINTS: return sizeof(Point);
+        case BLOCK_STROKES: return sizeof(Stroke);
+        case BLOCK_TEXT: return sizeof(char);
+        case BLOCK_CANVAS: return sizeof(Uint32);
+    }
+    return 0;
+}
+
+static bool valid_block(const ScratchBlock* block, size_t file_size, Uint64 index_offset) {
+    size_t size = element_size(block -> type);
+    if (size == 0) return false;
+    if (block -> offset > index_offset) return false;
+    if (block -> count > (index_offset - block -> offset) / size) return false;
+    return block -> offset % (block -> type == BLOCK_TEXT ? 1 : sizeof(long long)) == 0 && index_offset <= file_size;
+}
+
+// Applies every block of one type in order. Returns the final element count, or
+// (size_t) -1 when it can't be served from a single block.
+static size_t single_block(const ScratchBlock* index, size_t block_count, Uint32 type, const ScratchBlock** only) {
+    size_t blocks = 0;
+    *only = NULL;
+    for (size_t i = 0; i < block_count; i++) {
+        if (index[i].type != type) continue;
+        blocks++;
+        *only = &index[i];
+    }
+    if (blocks == 0) return 0;
+    if (blocks == 1 && (*only) -> first == 0) return (*only) -> count;
+    return (size_t) -1;
+}
+
+// Replays the blocks of one type into a fresh allocation
+static void* assemble(const Uint8* base, const ScratchBlock* index, size_t block_count, Uint32 type, size_t* count, size_t extra) {
+    size_t size = element_size(type);
+    size_t total = 0, capacity = 0;
+    Uint8* data = NULL;
+
+    for (size_t i = 0; i < block_count; i++) {
+        const ScratchBlock* block = &index[i];
+        if (block -> type != type) continue;
+        if (block -> first > total) {
+            free(data);
+            return NULL; // Gap, the file is corrupt
+        }
+
+        total = block -> first + block -> count;
+        if (total + extra > capacity) {
+            capacity = (total + extra) * 2;
+            Uint8* temp = realloc(data, capacity * size);
+            if (!temp) {
+                free(data);
+                return NULL;
+            }
+            data = temp;
+        }
+        memcpy(data + block -> first * size, base + block -> offset, block -> count * size);
+    }
+
+    if (!data) data = calloc(extra ? extra : 1, size);
+    *count = total;
+    return data;
+}
+
+// A crash during an append leaves a partial tail; the previous trailer is still intact
+static const ScratchTrailer* find_trailer(const Uint8* base, size_t size) {
+    for (size_t end = size - size % sizeof(Uint64); end >= sizeof(ScratchHeader) + sizeof(ScratchTrailer); end -= sizeof(Uint64)) {
+        const ScratchTrailer* trailer = (const ScratchTrailer*) (base + end - sizeof(ScratchTrailer));
+        if (memcmp(trailer -> magic, SCRATCH_INDEX_MAGIC, sizeof(trailer -> magic)) != 0) continue;
+
+        Uint64 index_end = end - sizeof(ScratchTrailer);
+        if (trailer -> index_offset <= index_end && trailer -> block_count == (index_end - trailer -> index_offset) / sizeof(ScratchBlock) &&
+            (index_end - trailer -> index_offset) % sizeof(ScratchBlock) == 0) {
+            return trailer;
+        }
+    }
+    return NULL;
+}
+
+// Maps and loads a file; index and size describe the valid part of the file
+static bool load_document(const char* path, ScratchDocument* doc, const ScratchBlock** index_out, size_t* block_count_out, size_t* valid_size) {
+    memset(doc, 0, sizeof(*doc));
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        printf("Couldn't open %s: %s\n", path, strerror(errno));
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t) st.st_size < sizeof(ScratchHeader) + sizeof(ScratchTrailer)) {
+        printf("%s is not a scratch file\n", path);
+        close(fd);
+        return false;
+    }
+
+    // Private and writable: the pages stay shared with the page cache until something writes them
+    void* mapping = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        printf("Couldn't map %s: %s\n", path, strerror(errno));
+        return false;
+    }
+    doc -> mapping = mapping;
+    doc -> mapping_size = st.st_size;
+
+    const Uint8* base = mapping;
+    const ScratchHeader* header = mapping;
+    if (memcmp(header -> magic, SCRATCH_MAGIC, sizeof(header -> magic)) != 0) {
+        printf("%s is not a scratch file\n", path);
+        document_close(doc);
+        return false;
+    }
+    if (header -> version != SCRATCH_VERSION || header -> byte_order != SCRATCH_BYTE_ORDER ||
+        header -> point_size != sizeof(Point) || header -> stroke_size != sizeof(Stroke)) {
+        printf("%s was written by an incompatible version\n", path);
+        document_close(doc);
+        return false;
+    }
+
+    const ScratchTrailer* trailer = find_trailer(base, st.st_size);
+    if (!trailer) {
+        printf("%s has a damaged index\n", path);
+        document_close(doc);
+        return false;
+    }
+    *valid_size = (const Uint8*) trailer - base + sizeof(ScratchTrailer);
+    if (*valid_size != (size_t) st.st_size) {
+        printf("%s: ignoring an unfinished save at the end\n", path);
+    }
+
+    const ScratchBlock* index = (const ScratchBlock*) (base + trailer -> index_offset);
+    size_t block_count = trailer -> block_count;
+    for (size_t i = 0; i < block_count; i++) {
+        if (!valid_block(&index[i], st.st_size, trailer -> index_offset)) {
+            printf("%s has a damaged block\n", path);
+            document_close(doc);
+            return false;
+        }
+    }
+
+    // Zero copy when possible, otherwise replay the blocks
+    const ScratchBlock* only;
+    size_t count = single_block(index, block_count, BLOCK_POINTS, &only);
+    if (count != (size_t) -1 && only) {
+        doc -> points = (Point*) (base + only -> offset);
+        doc -> point_count = count;
+        doc -> points_mapped = true;
+    } else {
+        doc -> points = assemble(base, index, block_count, BLOCK_POINTS, &doc -> point_count, 0);
+    }
+
+    count = single_block(index, block_count, BLOCK_STROKES, &only);
+    if (count != (size_t) -1 && only) {
+        doc -> strokes = (Stroke*) (base + only -> offset);
+        doc -> stroke_count = count;
+        doc -> strokes_mapped = true;
+    } else {
+        doc -> strokes = assemble(base, index, block_count, BLOCK_STROKES, &doc -> stroke_count, 0);
+    }
+
+    doc -> text = assemble(base, index, block_count, BLOCK_TEXT, &doc -> text_len, 1);
+
+    count = single_block(index, block_count, BLOCK_CANVAS, &only);
+    if (count != (size_t) -1 && only && only -> flags > 0 && count % only -> flags == 0 && count / only -> flags <= EXPORT_MAX_SIZE) {
+        doc -> canvas = (const Uint32*) (base + only -> offset);
+        doc -> canvas_width = only -> flags;
+        doc -> canvas_height = count / only -> flags;
+    }
+
+    if (!doc -> points || !doc -> strokes || !doc -> text) {
+        printf("Couldn't load %s\n", path);
+        document_close(doc);
+        return false;
+    }
+    doc -> text[doc -> text_len] = '\0';
+
+    // A stroke table that doesn't fit the points would send the renderer out of bounds
+    for (size_t i = 0; i < doc -> stroke_count; i++) {
+        if (doc -> strokes[i].first > doc -> point_count || doc -> strokes[i].count > doc -> point_count - doc -> strokes[i].first) {
+            printf("%s has a damaged stroke table\n", path);
+            document_close(doc);
+            return false;
+        }
+    }
+
+    *index_out = index;
+    *block_count_out = block_count;
+    return true;
+}
+
+static bool reserve_index(size_t block_count) {
+    if (block_count <= saved.index_capacity) return true;
+    ScratchBlock* temp = realloc(saved.index, block_count * 2 * sizeof(ScratchBlock));
+    if (!temp) return false;
+    saved.index = temp;
+    saved.index_capacity = block_count * 2;
+    return true;
+}
+
+static bool set_index(const ScratchBlock* index, size_t block_count) {
+    if (!reserve_index(block_count)) return false;
+    memcpy(saved.index, index, block_count * sizeof(ScratchBlock));
+    saved.block_count = block_count;
+    return true;
+}
+
+static bool set_saved_text(const char* text, size_t text_len) {
+    char* copy = malloc(text_len + 1);
+    if (!copy) return false;
+    memcpy(copy, text, text_len);
+    copy[text_len] = '\0';
+    free(saved.text);
+    saved.text = copy;
+    saved.text_len = text_len;
+    return true;
+}
+
+// Called with save_lock held
+static void track(const char* path, off_t file_size, const ScratchBlock* index, size_t block_count, size_t points, size_t strokes, const char* text, size_t text_len, Uint32 board) {
+    snprintf(saved.path, sizeof(saved.path), "%s", path);
+    saved.file_size = file_size;
+    saved.points = points;
+    saved.strokes = strokes;
+    saved.board = board;
+    saved.valid = set_index(index, block_count) && set_saved_text(text, text_len);
+}
+
+bool document_open(const char* path, ScratchDocument* doc, Uint32 board) {
+    const ScratchBlock* index;
+    size_t block_count, valid_size;
+    if (!load_document(path, doc, &index, &block_count, &valid_size)) return false;
+
+    // Later saves append to this file
+    SDL_LockMutex(save_lock);
+    track(path, valid_size, index, block_count, doc -> point_count, doc -> stroke_count, doc -> text, doc -> text_len, board);
+    SDL_UnlockMutex(save_lock);
+    return true;
+}
+
+void document_close(ScratchDocument* doc) {
+    if (!doc -> points_mapped) free(doc -> points);
+    if (!doc -> strokes_mapped) free(doc -> strokes);
+    free(doc -> text);
+    if (doc -> mapping) munmap(doc -> mapping, doc -> mapping_size);
+    memset(doc, 0, sizeof(*doc));
+}
+
+// Pads the file up to the next multiple of alignment and returns the new offset
+static bool pad_to(int fd, off_t* offset, size_t alignment) {
+    static const Uint8 zeros[SCRATCH_ALIGN] = {0};
+    size_t padding = (alignment - *offset % alignment) % alignment;
+    if (!write_all(fd, zeros, padding)) return false;
+    *offset += padding;
+    return true;
+}
+
+// Elements [first, first + count) of data. A tail replaces the last element (the live stroke of a snapshot).
+// Only a block from element 0 can be used straight from the mapping, so only that one starts a page;
+// the small blocks a delta save appends are just aligned for their elements.
+static bool write_block(int fd, off_t* offset, ScratchBlock* block, Uint32 type, const void* data, const void* tail, size_t first, size_t count) {
+    size_t alignment = type == BLOCK_TEXT ? 1 : first == 0 ? SCRATCH_ALIGN : sizeof(long long);
+    if (!pad_to(fd, offset, alignment)) return false;
+
+    size_t size = element_size(type);
+    block -> type = type;
+    block -> flags = 0;
+    block -> offset = *offset;
+    block -> first = first;
+    block -> count = count;
+
+    size_t from_data = tail && count ? count - 1 : count;
+    if (from_data && !write_all(fd, (const Uint8*) data + first * size, from_data * size)) return false;
+    if (from_data < count && !write_all(fd, tail, size)) return false;
+    *offset += count * size;
+    return true;
+}
+
+static bool write_index(int fd, off_t* offset, const ScratchBlock* index, size_t block_count) {
+    if (!pad_to(fd, offset, sizeof(Uint64))) return false;
+
+    ScratchTrailer trailer = {
+        .index_offset = *offset,
+        .block_count = block_count,
+        .magic = SCRATCH_INDEX_MAGIC,
+    };
+    if (!write_all(fd, index, block_count * sizeof(ScratchBlock)) || !write_all(fd, &trailer, sizeof(trailer))) return false;
+    *offset += block_count * sizeof(ScratchBlock) + sizeof(trailer);
+    return true;
+}
+
+// Complete file written next to path and renamed into place
+static bool write_full(const char* path, const Point* points, size_t point_count, const Stroke* strokes, const Stroke* live, size_t stroke_count, const char* text, size_t text_len,
+    const Uint32* canvas, int canvas_width, int canvas_height, ScratchBlock index[4], size_t* block_count, off_t* file_size) {
+    char temp_path[1100];
+    snprintf(temp_path, sizeof(temp_path), "%s.tmp", path);
+
+    int fd = open(temp_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        printf("Couldn't create %s: %s\n", temp_path, strerror(errno));
+        return false;
+    }
+
+    ScratchHeader header = {
+        .magic = SCRATCH_MAGIC,
+        .version = SCRATCH_VERSION,
+        .byte_order = SCRATCH_BYTE_ORDER,
+        .point_size = sizeof(Point),
+        .stroke_size = sizeof(Stroke),
+    };
+    off_t offset = sizeof(header);
+
+    bool written = write_all(fd, &header, sizeof(header)) &&
+        write_block(fd, &offset, &index[0], BLOCK_POINTS, points, NULL, 0, point_count) &&
+        write_block(fd, &offset, &index[1], BLOCK_STROKES, strokes, live, 0, stroke_count) &&
+        write_block(fd, &offset, &index[2], BLOCK_TEXT, text, NULL, 0, text_len);
+
+    *block_count = 3;
+    if (written && canvas) {
+        written = write_block(fd, &offset, &index[3], BLOCK_CANVAS, canvas, NULL, 0, (size_t) canvas_width * canvas_height);
+        index[3].flags = canvas_width;
+        *block_count = 4;
+    }
+    written = written && write_index(fd, &offset, index, *block_count) &&
+        fdatasync(fd) == 0;
+
+    if (close(fd) != 0) written = false;
+    if (written && rename(temp_path, path) != 0) written = false;
+
+    if (!written) {
+        printf("Couldn't save %s: %s\n", path, strerror(errno));
+        unlink(temp_path);
+        return false;
+    }
+    *file_size = offset;
+    return true;
+}
+
+bool document_open_cache(const char* path, ScratchDocument* doc) {
+    const ScratchBlock* index;
+    size_t block_count, valid_size;
+    return load_document(path, doc, &index, &block_count, &valid_size);
+}
+
+bool document_save_cache(const char* path, const Snapshot* snapshot, const Uint32* pixels, int width, int height) {
+    ScratchBlock index[4];
+    size_t block_count;
+    off_t file_size;
+    return write_full(path, snapshot -> points, snapshot -> point_count, snapshot -> strokes, &snapshot -> live, snapshot -> stroke_count,
+        snapshot -> text, snapshot -> text_len, pixels, width, height, index, &block_count, &file_size);
+}
+
+// Called with save_lock held
+static bool save_full(const char* path, const Snapshot* snapshot) {
+    ScratchBlock index[4];
+    size_t block_count;
+    off_t file_size;
+
+    if (!write_full(path, snapshot -> points, snapshot -> point_count, snapshot -> strokes, &snapshot -> live, snapshot -> stroke_count,
+        snapshot -> text, snapshot -> text_len, NULL, 0, 0, index, &block_count, &file_size)) {
+        return false;
+    }
+    track(path, file_size, index, block_count, snapshot -> point_count, snapshot -> stroke_count, snapshot -> text, snapshot -> text_len, snapshot -> board);
+    saved.version = snapshot -> version;
+    return true;
+}
+
+// A newer snapshot of the same board already reached the file
+static bool superseded(const char* path, const Snapshot* snapshot) {
+    return saved.valid && strcmp(saved.path, path) == 0 && snapshot -> version < saved.version;
+}
+
+bool document_save(const char* path, const Snapshot* snapshot) {
+    SDL_LockMutex(save_lock);
+    bool written = superseded(path, snapshot) || save_full(path, snapshot);
+    SDL_UnlockMutex(save_lock);
+    return written;
+}
+
+// Low priority job that rewrites the file without the garbage. The result is only
+// kept if nobody appended to the file in the meantime.
+static void compact(void* data) {
+    (void) data;
+
+    SDL_LockMutex(save_lock);
+    char path[sizeof(saved.path)];
+    memcpy(path, saved.path, sizeof(path));
+    off_t size_before = saved.file_size;
+    SDL_UnlockMutex(save_lock);
+
+    char compact_path[1100];
+    snprintf(compact_path, sizeof(compact_path), "%s.compact", path);
+
+    ScratchDocument doc;
+    const ScratchBlock* old_index;
+    size_t old_blocks, valid_size;
+    ScratchBlock index[4];
+    size_t block_count;
+    off_t file_size;
+    bool written = false;
+
+    if (load_document(path, &doc, &old_index, &old_blocks, &valid_size) && (off_t) valid_size == size_before) {
+        written = write_full(compact_path, doc.points, doc.point_count, doc.strokes, NULL, doc.stroke_count, doc.text, doc.text_len,
+            doc.canvas, doc.canvas_width, doc.canvas_height, index, &block_count, &file_size);
+    }
+
+    SDL_LockMutex(save_lock);
+    if (written && saved.valid && saved.file_size == size_before && strcmp(saved.path, path) == 0 && rename(compact_path, path) == 0) {
+        saved.file_size = file_size;
+        set_index(index, block_count);
+        printf("Compacted %s: %lld -> %lld bytes\n", path, (long long) size_before, (long long) file_size);
+    } else if (written) {
+        unlink(compact_path);
+    }
+    compacting = false;
+    SDL_CondBroadcast(compacted);
+    SDL_UnlockMutex(save_lock);
+
+    document_close(&doc);
+}
+
+// Bytes that no longer describe the drawing: replaced text, overwritten strokes,
+// blocks from before a reset, old indexes and padding.
+// Called with save_lock held; true: the caller submits compact once it let go.
+static bool should_compact(void) {
+    off_t live = sizeof(ScratchHeader) + saved.points * sizeof(Point) + saved.strokes * sizeof(Stroke) + saved.text_len +
+        saved.block_count * sizeof(ScratchBlock) + sizeof(ScratchTrailer);
+    off_t garbage = saved.file_size - live;
+
+    if (compacting || saved.file_size < DOCUMENT_COMPACT_MIN || garbage < saved.file_size * DOCUMENT_GARBAGE_RATIO) return false;
+    compacting = true;
+    return true;
+}
+
+int document_save_delta(const char* path, const Snapshot* snapshot) {
+    const Point* points = snapshot -> points;
+    size_t point_count = snapshot -> point_count, stroke_count = snapshot -> stroke_count, text_len = snapshot -> text_len;
+    const char* text = snapshot -> text;
+
+    SDL_LockMutex(save_lock);
+    if (superseded(path, snapshot)) {
+        SDL_UnlockMutex(save_lock);
+        return 0;
+    }
+
+    // Anything we can't append to safely gets a fresh file
+    struct stat st;
+    if (!saved.valid || strcmp(saved.path, path) != 0 || stat(path, &st) != 0 || st.st_size < saved.file_size) {
+        int written = save_full(path, snapshot) ? (int) point_count : -1;
+        SDL_UnlockMutex(save_lock);
+        return written;
+    }
+
+    // Points only ever grow within a board generation. The last saved stroke may have grown since.
+    bool same_board = snapshot -> board == saved.board;
+    size_t first_point = same_board ? saved.points : 0;
+    size_t first_stroke = same_board && saved.strokes ? saved.strokes - 1 : 0;
+    size_t first_char = 0;
+    while (first_char < text_len && first_char < saved.text_len && text[first_char] == saved.text[first_char]) first_char++;
+    if (first_point > point_count) first_point = point_count;
+    if (first_stroke > stroke_count) first_stroke = stroke_count;
+
+    bool new_points = point_count > first_point || first_point < saved.points;
+    bool new_text = text_len > first_char || first_char < saved.text_len;
+    if (!new_points && !new_text) {
+        SDL_UnlockMutex(save_lock);
+        return 0;
+    }
+
+    if (!reserve_index(saved.block_count + 3)) {
+        SDL_UnlockMutex(save_lock);
+        return -1;
+    }
+
+    int fd = open(path, O_WRONLY);
+    off_t offset = saved.file_size;
+    bool written = fd >= 0 && lseek(fd, offset, SEEK_SET) == offset;
+
+    size_t block_count = saved.block_count;
+    if (written && new_points) {
+        written = write_block(fd, &offset, &saved.index[block_count++], BLOCK_POINTS, points, NULL, first_point, point_count - first_point) &&
+            write_block(fd, &offset, &saved.index[block_count++], BLOCK_STROKES, snapshot -> strokes, &snapshot -> live, first_stroke, stroke_count - first_stroke);
+    }
+    if (written && new_text) {
+        written = write_block(fd, &offset, &saved.index[block_count++], BLOCK_TEXT, text, NULL, first_char, text_len - first_char);
+    }
+    written = written && write_index(fd, &offset, saved.index, block_count) && fdatasync(fd) == 0;
+    if (fd >= 0 && close(fd) != 0) written = false;
+
+    if (!written) {
+        // The old trailer is still intact, but don't build on a partial tail
+        printf("Couldn't save %s: %s\n", path, strerror(errno));
+        saved.valid = false;
+        SDL_UnlockMutex(save_lock);
+        return -1;
+    }
+
+    saved.block_count = block_count;
+    saved.file_size = offset;
+    saved.points = point_count;
+    saved.strokes = stroke_count;
+    saved.board = snapshot -> board;
+    saved.version = snapshot -> version;
+    if (new_text) saved.valid = set_saved_text(text, text_len);
+
+    bool start_compaction = should_compact();
+    SDL_UnlockMutex(save_lock);
+
+    if (start_compaction) job_submit(job_create("compact", JOB_LOW, compact, NULL, NULL));
+    return (int) (point_count - first_point);
+}
+
+bool document_init(void) {
+    save_lock = SDL_CreateMutex();
+    compacted = SDL_CreateCond();
+    if (!save_lock || !compacted) {
+        printf("Couldn't create save lock: %s\n", SDL_GetError());
+        return false;
+    }
+    return true;
+}
+
+void document_shutdown(void) {
+    SDL_LockMutex(save_lock);
+    while (compacting) SDL_CondWait(compacted, save_lock);
+    SDL_UnlockMutex(save_lock);
+    SDL_DestroyCond(compacted);
+    compacted = NULL;
+
+    free(saved.index);
+    free(saved.text);
+    memset(&saved, 0, sizeof(saved));
+    SDL_DestroyMutex(save_lock);
+    save_lock = NULL;
+}
@@ -0,0 +1,109 @@
+#ifndef DOCUMENT_H
+#define DOCUMENT_H
+
+#include <SDL2/SDL.h>
+#include <stdbool.h>
+
+#include "__struct.h"
+#include "snapshot.h"
+
+/*
+ * .scratch file layout (native byte order, checked through the header):
+ *
+ *   ScratchHeader                      at offset 0
+ *   blocks                             from element 0: aligned to SCRATCH_ALIGN,
+ *                                      appended ones: to 8 bytes
+ *   ScratchBlock index[block_count]
+ *   ScratchTrailer                     last bytes of the file
+ *
+ * A block holds elements [first, first + count) of the points, the stroke
+ * table or the text. Blocks are applied in index order and each one first
+ * truncates its array to first, so a file can also describe edits.
+ *
+ * Saving appends: the new blocks, then a new index and trailer. Earlier
+ * indexes stay behind as garbage until the file is compacted, and a save
+ * cut short by a crash still leaves the previous trailer to open from.
+ *
+ * Point and stroke blocks are stored exactly as they are in memory, which lets
+ * the renderer use them straight from the mapping.
+ */
+
+#define SCRATCH_MAGIC "SCRATCH"
+#define SCRATCH_INDEX_MAGIC "SCRINDEX"
+#define SCRATCH_VERSION 1
+#define SCRATCH_BYTE_ORDER 0x01020304
+#define SCRATCH_ALIGN 4096
+
+typedef struct {
+    char magic[8];
+    Uint32 version;
+    Uint32 byte_order;
+    Uint32 point_size, stroke_size; // sizeof(Point), sizeof(Stroke) of the writer
+} ScratchHeader;
+
+typedef enum {
+    BLOCK_POINTS = 1,
+    BLOCK_STROKES = 2,
+    BLOCK_TEXT = 3,
+    BLOCK_CANVAS = 4, // ARGB8888 pixels of the last frame, flags holds the width
+} ScratchBlockType;
+
+typedef struct {
+    Uint32 type, flags;
+    Uint64 offset;       // from the start of the file
+    Uint64 first, count; // in elements
+} ScratchBlock;
+
+typedef struct {
+    Uint64 index_offset, block_count;
+    char magic[8];
+} ScratchTrailer;
+
+// An opened document. points and strokes may point into the mapping, in which
+// case they must be copied before they are modified or grown.
+typedef struct {
+    void* mapping;
+    size_t mapping_size;
+
+    Point* points;
+    size_t point_count;
+    bool points_mapped;
+
+    Stroke* strokes;
+    size_t stroke_count;
+    bool strokes_mapped;
+
+    char* text; // malloc'ed, NUL terminated
+    size_t text_len;
+
+    const Uint32* canvas; // In the mapping, NULL when the file has none
+    int canvas_width, canvas_height;
+} ScratchDocument;
+
+bool document_init(void);
+void document_shutdown(void); // Waits for a running compaction
+
+// Maps the file. Nothing is parsed: when the file has a single point and stroke
+// block they are used in place and only paged in once something reads them.
+// board is the generation the board has once doc is adopted.
+bool document_open(const char* path, ScratchDocument* doc, Uint32 board);
+void document_close(ScratchDocument* doc);
+
+// Warm start cache: a regular document plus the pixels of the last frame, so the
+// next launch can show the board before anything is rasterized. Opening it
+// doesn't make it the target of later saves.
+bool document_open_cache(const char* path, ScratchDocument* doc);
+bool document_save_cache(const char* path, const Snapshot* snapshot, const Uint32* pixels, int width, int height);
+
+// Writes a complete document next to path and renames it into place.
+// Safe from any thread; a snapshot older than the one on disk is skipped.
+bool document_save(const char* path, const Snapshot* snapshot);
+
+// Appends only what changed since the file was last saved or opened, so the cost
+// follows the new work, not the size of the drawing. Falls back to a full save
+// for a new path. Starts a background compaction once more than
+// DOCUMENT_GARBAGE_RATIO of the file is garbage.
+// Returns the number of points written, or -1.
+int document_save_delta(const char* path, const Snapshot* snapshot);
+
+#endif
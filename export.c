@@ -0,0 +1,566 @@
+#include <SDL2/SDL.h>
+#include <SDL2/SDL_image.h>
+#include <png.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include "__macros.h"
+#include "export.h"
+#include "raster.h"
+#include "jobs.h"
+
+// Pixel snapshot handed from the render thread to an encode job
+typedef struct {
+    void* pixels;
+    size_t capacity; // bytes allocated for pixels
+    int width, height, pitch;
+    bool in_use;
+} PixelBuffer;
+
+Uint32 EXPORT_EVENT = (Uint32) -1;
+
+static PixelBuffer pool[EXPORT_POOL_SIZE];
+
+static SDL_mutex* export_lock = NULL;
+static SDL_cond* buffer_free = NULL;  // capture and shutdown wait on this
+
+// Next index to try. Shared by every export so names never collide.
+static SDL_atomic_t next_index;
+
+static void load_sequence(void) {
+    // Ensure folder Exists:
+    struct stat st = {0};
+    if (stat(FOLDER, &st) == -1) {
+        mkdir(FOLDER, 0700);
+    }
+
+    int index = 0;
+    FILE* fp = fopen(FOLDER EXPORT_SEQUENCE_FILE, "r");
+    if (fp) {
+        if (fscanf(fp, "%d", &index) != 1 || index < 0) index = 0;
+        fclose(fp);
+    }
+    SDL_AtomicSet(&next_index, index);
+}
+
+// Fixed width so it can be overwritten in place without truncating
+static void store_sequence(int index) {
+    int fd = open(FOLDER EXPORT_SEQUENCE_FILE, O_WRONLY | O_CREAT, 0600);
+    if (fd < 0) return;
+
+    char text[16];
+    int len = snprintf(text, sizeof(text), "%010d\n", index);
+    if (pwrite(fd, text, len, 0) != len) {
+        printf("Couldn't update export sequence\n");
+    }
+    close(fd);
+}
+
+bool write_all(int fd, const void* data, size_t size) {
+    const Uint8* bytes = data;
+    while (size > 0) {
+        ssize_t written = write(fd, bytes, size);
+        if (written < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        bytes += written;
+        size -= written;
+    }
+    return true;
+}
+
+static bool name_taken(const char* prefix, const char* extension, int index, char* path, size_t path_size) {
+    snprintf(path, path_size, "%s%s%03d.%s", FOLDER, prefix, index, extension);
+    return access(path, F_OK) == 0;
+}
+
+int export_reserve(const char* prefix, const char* extension, char* path, size_t path_size) {
+    int index = SDL_AtomicAdd(&next_index, 1);
+
+    while (true) {
+        snprintf(path, path_size, "%s%s%03d.%s", FOLDER, prefix, index, extension);
+
+        // O_EXCL makes the reservation atomic, even against other instances
+        int fd = open(path, O_WRONLY | O_CREAT | O_EXCL, 0644);
+        if (fd >= 0) {
+            int current = SDL_AtomicGet(&next_index);
+            while (current < index + 1 && !SDL_AtomicCAS(&next_index, current, index + 1)) {
+                current = SDL_AtomicGet(&next_index);
+            }
+            store_sequence(current > index + 1 ? current : index + 1); // Whatever the other exports claimed too
+            return fd;
+        }
+
+        if (errno != EEXIST) {
+            printf("Couldn't create %s: %s\n", path, strerror(errno));
+            return -1;
+        }
+
+        // Taken by an older file or another instance: gallop past the used run,
+        // then binary search back for its end so no free name is skipped
+        int taken = index, step = 1, free_index = index + 1;
+        while (name_taken(prefix, extension, free_index, path, path_size)) {
+            taken = free_index;
+            if (step < (1 << 16)) step *= 2;
+            free_index = taken + step;
+        }
+        while (free_index - taken > 1) {
+            int middle = taken + (free_index - taken) / 2;
+            if (name_taken(prefix, extension, middle, path, path_size)) {
+                taken = middle;
+            } else {
+                free_index = middle;
+            }
+        }
+        index = free_index;
+    }
+}
+
+void export_notify(int status, const char* path) {
+    SDL_Event event;
+    memset(&event, 0, sizeof(event));
+    event.type = EXPORT_EVENT;
+    event.user.code = status;
+    event.user.data1 = path ? strdup(path) : NULL;
+    if (SDL_PushEvent(&event) < 0) {
+        free(event.user.data1);
+    }
+}
+
+static void encode(PixelBuffer* buffer) {
+    SDL_Surface *surface = SDL_CreateRGBSurfaceFrom(buffer -> pixels, buffer -> width, buffer -> height, 32, buffer -> pitch, 0x00FF0000, 0x0000FF00, 0x000000FF, 0xFF000000);
+    if (!surface) {
+        printf("Unable to create surface: %s\n", SDL_GetError());
+        export_notify(-1, NULL);
+        return;
+    }
+
+    char filename[256];
+    int fd = export_reserve("__image__", "png", filename, sizeof(filename));
+    if (fd < 0) {
+        SDL_FreeSurface(surface);
+        export_notify(-1, NULL);
+        return;
+    }
+    close(fd); // IMG_SavePNG reopens it by name
+
+    // Save surface to PNG
+    if (IMG_SavePNG(surface, filename) != 0) {
+        printf("Unable to save frame as PNG: %s\n", IMG_GetError());
+        unlink(filename);
+        export_notify(-1, filename);
+    } else {
+        export_notify(0, filename);
+    }
+
+    SDL_FreeSurface(surface);
+}
+
+static void release_buffer(PixelBuffer* buffer);
+
+// Captures are encoded in parallel, at most EXPORT_POOL_SIZE at a time
+static void encode_job(void* data) {
+    PixelBuffer* buffer = data;
+    encode(buffer);
+    release_buffer(buffer);
+}
+
+bool export_init(void) {
+    load_sequence();
+
+    EXPORT_EVENT = SDL_RegisterEvents(1);
+    if (EXPORT_EVENT == (Uint32) -1) {
+        printf("Couldn't register export event: %s\n", SDL_GetError());
+        return false;
+    }
+
+    export_lock = SDL_CreateMutex();
+    buffer_free = SDL_CreateCond();
+    if (!export_lock || !buffer_free) {
+        printf("Couldn't create export locks: %s\n", SDL_GetError());
+        return false;
+    }
+    return true;
+}
+
+void export_shutdown(void) {
+    if (!export_lock) return;
+
+    // Pending captures are still written out
+    SDL_LockMutex(export_lock);
+    for (size_t i = 0; i < EXPORT_POOL_SIZE; i++) {
+        while (pool[i].in_use) SDL_CondWait(buffer_free, export_lock);
+    }
+    SDL_UnlockMutex(export_lock);
+
+    for (size_t i = 0; i < EXPORT_POOL_SIZE; i++) {
+        free(pool[i].pixels);
+        pool[i] = (PixelBuffer) {0};
+    }
+
+    SDL_DestroyCond(buffer_free);
+    SDL_DestroyMutex(export_lock);
+    buffer_free = NULL;
+    export_lock = NULL;
+}
+
+static void release_buffer(PixelBuffer* buffer) {
+    SDL_LockMutex(export_lock);
+    buffer -> in_use = false;
+    SDL_CondBroadcast(buffer_free);
+    SDL_UnlockMutex(export_lock);
+}
+
+// Blocks only when every pooled buffer is still waiting to be encoded
+static PixelBuffer* acquire_buffer(size_t size) {
+    PixelBuffer* buffer = NULL;
+
+    SDL_LockMutex(export_lock);
+    while (!buffer) {
+        // Prefer an idle buffer that is already big enough
+        for (size_t i = 0; i < EXPORT_POOL_SIZE; i++) {
+            if (pool[i].in_use) continue;
+            if (!buffer || (pool[i].capacity >= size && buffer -> capacity < size)) {
+                buffer = &pool[i];
+            }
+        }
+        if (!buffer) SDL_CondWait(buffer_free, export_lock);
+    }
+    buffer -> in_use = true;
+    SDL_UnlockMutex(export_lock);
+
+    if (buffer -> capacity < size) {
+        void* temp = realloc(buffer -> pixels, size);
+        if (!temp) {
+            fprintf(stderr, "Memory allocation failed!\n");
+            release_buffer(buffer);
+            return NULL;
+        }
+        buffer -> pixels = temp;
+        buffer -> capacity = size;
+    }
+    return buffer;
+}
+
+bool SaveAsImage(SDL_Renderer* renderer) {
+    if (!export_lock) {
+        printf("Exports are not set up\n");
+        return false;
+    }
+
+    int win_width, win_height;
+    SDL_GetRendererOutputSize(renderer, &win_width, &win_height);
+
+    int pitch = win_width * 4;
+    PixelBuffer* buffer = acquire_buffer((size_t) pitch * win_height);
+    if (!buffer) return false;
+
+    if (SDL_RenderReadPixels(renderer, NULL, SDL_PIXELFORMAT_ARGB8888, buffer -> pixels, pitch) < 0) {
+        printf("Unable to read pixels: %s\n", SDL_GetError());
+        release_buffer(buffer);
+        return false;
+    }
+    buffer -> width = win_width;
+    buffer -> height = win_height;
+    buffer -> pitch = pitch;
+
+    job_submit(job_create("encode", JOB_HIGH, encode_job, NULL, buffer));
+    return true;
+}
+
+// Smallest canvas that holds the whole drawing, never below RENDER_WINDOW size
+static void canvas_size(const CanvasExport* job, int* width, int* height) {
+    long long scale = job -> scale;
+    long long max_x = RENDER_WINDOW_WIDTH * scale, max_y = RENDER_WINDOW_HEIGHT * scale;
+
+    for (size_t i = 0; i < job -> point_count; i++) {
+        const Point* p = &job -> points[i];
+        long long reach = (p -> line_thickness * scale) / 2 + 2;
+        if (p -> x * scale + reach > max_x) max_x = p -> x * scale + reach;
+        if (p -> y * scale + reach > max_y) max_y = p -> y * scale + reach;
+    }
+    if (job -> text) {
+        if (job -> text_x + job -> text -> w > max_x) max_x = job -> text_x + job -> text -> w;
+        if (job -> text_y + job -> text -> h > max_y) max_y = job -> text_y + job -> text -> h;
+    }
+
+    *width = max_x > EXPORT_MAX_SIZE ? EXPORT_MAX_SIZE : max_x;
+    *height = max_y > EXPORT_MAX_SIZE ? EXPORT_MAX_SIZE : max_y;
+}
+
+// Segments bucketed by the tile they touch, so a tile never scans the whole drawing.
+// Cell (col, row) owns entries[start[cell] .. start[cell + 1]), each the index of p1.
+typedef struct {
+    int columns, rows;
+    size_t* start;
+    Uint32* entries;
+} SegmentGrid;
+
+static bool segment_cells(const CanvasExport* job, size_t i, int width, int height, int cells[4]) {
+    const Point* p1 = &job -> points[i];
+    const Point* p2 = &job -> points[i + 1];
+    if (!(p1 -> connect && p2 -> connect)) return false;
+
+    long long scale = job -> scale;
+    long long margin = (p1 -> line_thickness * scale) / 2 + 2;
+    long long min_x = (p1 -> x < p2 -> x ? p1 -> x : p2 -> x) * scale - margin;
+    long long max_x = (p1 -> x > p2 -> x ? p1 -> x : p2 -> x) * scale + margin;
+    long long min_y = (p1 -> y < p2 -> y ? p1 -> y : p2 -> y) * scale - margin;
+    long long max_y = (p1 -> y > p2 -> y ? p1 -> y : p2 -> y) * scale + margin;
+    if (max_x < 0 || max_y < 0 || min_x >= width || min_y >= height) return false;
+
+    cells[0] = (min_x < 0 ? 0 : min_x) / EXPORT_TILE_SIZE;
+    cells[1] = (min_y < 0 ? 0 : min_y) / EXPORT_BAND_HEIGHT;
+    cells[2] = (max_x >= width ? width - 1 : max_x) / EXPORT_TILE_SIZE;
+    cells[3] = (max_y >= height ? height - 1 : max_y) / EXPORT_BAND_HEIGHT;
+    return true;
+}
+
+static bool build_grid(SegmentGrid* grid, const CanvasExport* job, int width, int height) {
+    grid -> columns = (width + EXPORT_TILE_SIZE - 1) / EXPORT_TILE_SIZE;
+    grid -> rows = (height + EXPORT_BAND_HEIGHT - 1) / EXPORT_BAND_HEIGHT;
+    size_t cell_count = (size_t) grid -> columns * grid -> rows;
+
+    grid -> start = calloc(cell_count + 1, sizeof(size_t));
+    if (!grid -> start) return false;
+
+    // Count, prefix sum, then fill
+    int cells[4];
+    for (size_t i = 0; i + 1 < job -> point_count; i++) {
+        if (!segment_cells(job, i, width, height, cells)) continue;
+        for (int row = cells[1]; row <= cells[3]; row++) {
+            for (int col = cells[0]; col <= cells[2]; col++) {
+                grid -> start[(size_t) row * grid -> columns + col + 1]++;
+            }
+        }
+    }
+    for (size_t cell = 0; cell < cell_count; cell++) {
+        grid -> start[cell + 1] += grid -> start[cell];
+    }
+
+    grid -> entries = malloc((grid -> start[cell_count] + 1) * sizeof(Uint32));
+    size_t* fill = malloc(cell_count * sizeof(size_t));
+    if (!grid -> entries || !fill) {
+        free(fill);
+        return false;
+    }
+    memcpy(fill, grid -> start, cell_count * sizeof(size_t));
+
+    for (size_t i = 0; i + 1 < job -> point_count; i++) {
+        if (!segment_cells(job, i, width, height, cells)) continue;
+        for (int row = cells[1]; row <= cells[3]; row++) {
+            for (int col = cells[0]; col <= cells[2]; col++) {
+                grid -> entries[fill[(size_t) row * grid -> columns + col]++] = (Uint32) i;
+            }
+        }
+    }
+    free(fill);
+    return true;
+}
+
+static void free_grid(SegmentGrid* grid) {
+    free(grid -> start);
+    free(grid -> entries);
+}
+
+// One canvas export in flight. Each band is rasterized by one job per tile; a job
+// after them compresses the band. It first queues the tiles of the next band into
+// the other buffer, so rasterizing and deflate overlap, then queues its own
+// successor once the band is written. The last one in the chain cleans up.
+typedef struct {
+    CanvasExport job;
+    SegmentGrid grid;
+    int width, height;
+    Uint32* bands[2];
+
+    FILE* fp;
+    char filename[256];
+    png_structp png;
+    png_infop info;
+    bool failed;
+} CanvasRun;
+
+// Data of a tile job or a band job
+typedef struct {
+    CanvasRun* run;
+    int band, tile;
+} BandPart;
+
+static int band_height(const CanvasRun* run, int band) {
+    int band_y = band * EXPORT_BAND_HEIGHT;
+    return run -> height - band_y < EXPORT_BAND_HEIGHT ? run -> height - band_y : EXPORT_BAND_HEIGHT;
+}
+
+static void tile_job(void* data) {
+    BandPart* part = data;
+    CanvasRun* run = part -> run;
+    const CanvasExport* job = &run -> job;
+    int x = part -> tile * EXPORT_TILE_SIZE;
+
+    RasterTarget target = {
+        .pixels = run -> bands[part -> band % 2] + x,
+        .pitch = run -> width,
+        .x = x,
+        .y = part -> band * EXPORT_BAND_HEIGHT,
+        .w = run -> width - x < EXPORT_TILE_SIZE ? run -> width - x : EXPORT_TILE_SIZE,
+        .h = band_height(run, part -> band),
+    };
+    raster_clear(&target, job -> background);
+
+    size_t cell = (size_t) part -> band * run -> grid.columns + part -> tile;
+    for (size_t k = run -> grid.start[cell]; k < run -> grid.start[cell + 1]; k++) {
+        const Point* p1 = &job -> points[run -> grid.entries[k]];
+        const Point* p2 = p1 + 1;
+        raster_line(&target, p1 -> x * job -> scale, p1 -> y * job -> scale, p2 -> x * job -> scale, p2 -> y * job -> scale, p1 -> line_thickness * job -> scale, job -> foreground);
+    }
+    raster_surface(&target, job -> text, job -> text_x, job -> text_y);
+    free(part);
+}
+
+static BandPart* band_part(CanvasRun* run, int band, int tile) {
+    BandPart* part = malloc(sizeof(BandPart));
+    if (!part) {
+        fprintf(stderr, "Memory allocation failed!\n");
+        exit(1);
+    }
+    *part = (BandPart) {run, band, tile};
+    return part;
+}
+
+static void band_job(void* data);
+
+// Submits the tiles of band right away; the returned band job waits for them
+// and must be submitted by the caller once the previous band is written
+static Job* queue_band(CanvasRun* run, int band) {
+    Job* compress = job_create("export band", JOB_HIGH, band_job, NULL, band_part(run, band, 0));
+    Job* tiles[EXPORT_MAX_SIZE / EXPORT_TILE_SIZE + 1];
+    for (int tile = 0; tile < run -> grid.columns; tile++) {
+        tiles[tile] = job_create("export tile", JOB_HIGH, tile_job, NULL, band_part(run, band, tile));
+        job_after(compress, tiles[tile]);
+    }
+    for (int tile = 0; tile < run -> grid.columns; tile++) {
+        job_submit(tiles[tile]);
+    }
+    return compress;
+}
+
+static void finish_canvas(CanvasRun* run) {
+    bool saved = !run -> failed;
+    if (run -> png) png_destroy_write_struct(&run -> png, &run -> info);
+    if (fclose(run -> fp) != 0) saved = false;
+
+    if (!saved) {
+        printf("Unable to save canvas as PNG\n");
+        unlink(run -> filename);
+    }
+    export_notify(saved ? 0 : -1, run -> filename);
+
+    SDL_FreeSurface(run -> job.text);
+    if (run -> job.finished) run -> job.finished(run -> job.finished_data);
+    free(run -> bands[0]);
+    free(run -> bands[1]);
+    free_grid(&run -> grid);
+    free(run);
+}
+
+static void band_job(void* data) {
+    BandPart* part = data;
+    CanvasRun* run = part -> run;
+    int band = part -> band;
+    free(part);
+
+    bool last = band + 1 == run -> grid.rows;
+    Job* next = run -> failed || last ? NULL : queue_band(run, band + 1);
+
+    // libpng reports errors by jumping back here
+    if (!run -> failed && setjmp(png_jmpbuf(run -> png))) {
+        run -> failed = true;
+    } else if (!run -> failed) {
+        Uint32* pixels = run -> bands[band % 2];
+        for (int row = 0; row < band_height(run, band); row++) {
+            png_write_row(run -> png, (png_const_bytep) (pixels + (size_t) row * run -> width));
+        }
+        if (last) png_write_end(run -> png, NULL);
+    }
+
+    // A failed band still lets the tiles already queued into the other buffer finish
+    if (next) {
+        job_submit(next);
+    } else {
+        finish_canvas(run);
+    }
+}
+
+static bool start_png(CanvasRun* run) {
+    run -> png = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+    run -> info = run -> png ? png_create_info_struct(run -> png) : NULL;
+    if (!run -> info) return false;
+    if (setjmp(png_jmpbuf(run -> png))) return false;
+
+    png_init_io(run -> png, run -> fp);
+    png_set_IHDR(run -> png, run -> info, run -> width, run -> height, 8, PNG_COLOR_TYPE_RGB, PNG_INTERLACE_NONE, PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT);
+    // Deflate dominates big supersampled exports; the fastest level costs little on flat boards
+    if (run -> job.scale > 1) {
+        png_set_compression_level(run -> png, 1);
+        png_set_filter(run -> png, PNG_FILTER_TYPE_BASE, PNG_FILTER_SUB);
+    }
+    png_write_info(run -> png, run -> info);
+
+    // Rows are ARGB8888 words, let libpng drop the alpha byte
+#if SDL_BYTEORDER == SDL_LIL_ENDIAN
+    png_set_bgr(run -> png);
+    png_set_filler(run -> png, 0, PNG_FILLER_AFTER);
+#else
+    png_set_filler(run -> png, 0, PNG_FILLER_BEFORE);
+#endif
+    return true;
+}
+
+bool ExportCanvas(const CanvasExport* job) {
+    CanvasRun* run = calloc(1, sizeof(CanvasRun));
+    if (!run) {
+        fprintf(stderr, "Memory allocation failed!\n");
+        exit(1);
+    }
+    run -> job = *job;
+    canvas_size(job, &run -> width, &run -> height);
+
+    int fd = export_reserve("__canvas__", "png", run -> filename, sizeof(run -> filename));
+    run -> fp = fd >= 0 ? fdopen(fd, "wb") : NULL;
+    if (!run -> fp) {
+        if (fd >= 0) {
+            close(fd);
+            unlink(run -> filename);
+        }
+        export_notify(-1, fd >= 0 ? run -> filename : NULL);
+        SDL_FreeSurface(run -> job.text);
+        if (job -> finished) job -> finished(job -> finished_data);
+        free(run);
+        return false;
+    }
+
+    bool ready = job -> point_count <= UINT32_MAX && build_grid(&run -> grid, job, run -> width, run -> height);
+    if (ready) {
+        run -> bands[0] = malloc((size_t) run -> width * EXPORT_BAND_HEIGHT * sizeof(Uint32));
+        run -> bands[1] = malloc((size_t) run -> width * EXPORT_BAND_HEIGHT * sizeof(Uint32));
+        ready = run -> bands[0] && run -> bands[1];
+    }
+    if (!ready) fprintf(stderr, "Memory allocation failed!\n");
+    if (!ready || !start_png(run)) {
+        run -> failed = true;
+        finish_canvas(run);
+        return false;
+    }
+
+    job_submit(queue_band(run, 0));
+    return true;
+}
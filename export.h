@@ -0,0 +1,51 @@
+#ifndef EXPORT_H
+#define EXPORT_H
+
+#include <SDL2/SDL.h>
+#include <stdbool.h>
+
+#include "__struct.h"
+#include "jobs.h"
+
+// Pushed when an export has been written (or failed to).
+// event.user.code: 0 on success, -1 on failure
+// event.user.data1: malloc'ed path of the file, caller frees it
+extern Uint32 EXPORT_EVENT;
+
+bool export_init(void);
+void export_shutdown(void);
+
+// Posts EXPORT_EVENT for an export that finished on any thread
+void export_notify(int status, const char* path);
+
+// write() until all of data is out, through short writes and EINTR
+bool write_all(int fd, const void* data, size_t size);
+
+// Creates a new, unused file "<FOLDER><prefix><index>.<extension>" and returns its
+// descriptor (or -1). Constant time: no directory listing, no shell.
+int export_reserve(const char* prefix, const char* extension, char* path, size_t path_size);
+
+// Copies the current frame into a pooled buffer and queues it for encoding.
+// Only the pixel read back happens on the calling thread.
+bool SaveAsImage(SDL_Renderer* renderer);
+
+// Everything needed to re-rasterize the board away from the window
+typedef struct {
+    const Point* points;
+    size_t point_count;
+    int scale;         // Supersampling factor applied to coordinates and thickness
+    SDL_Surface* text; // Already laid out at the export scale, may be NULL. Freed by the export.
+    int text_x, text_y;
+    SDL_Color foreground, background;
+    JobFunction finished; // Runs with finished_data on a worker once the points aren't read anymore, may be NULL
+    void* finished_data;
+} CanvasExport;
+
+// Redraws the whole board at scale times RENDER_WINDOW_WIDTH x RENDER_WINDOW_HEIGHT
+// (or larger if the drawing extends further) and streams it to a PNG one band of
+// EXPORT_BAND_HEIGHT rows at a time. Each band is split into EXPORT_TILE_SIZE wide
+// tiles, each rasterized as a job. Returns once the first band is queued; the
+// result is reported through EXPORT_EVENT. false: it couldn't even start.
+bool ExportCanvas(const CanvasExport* job);
+
+#endif
@@ -0,0 +1,121 @@
+#include <SDL2/SDL.h>
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "__macros.h"
+#include "governor.h"
+
+static GovernorStats state;
+static SDL_SpinLock stats_lock = 0; // Only guards against readers on other threads
+
+static const char* mode_name(GovernorMode mode) {
+    return mode == GOVERNOR_DRAWING ? "drawing" : "idle";
+}
+
+// Called with stats_lock held
+static void transition(GovernorMode mode, const char* reason) {
+    if (state.history_count == GOVERNOR_HISTORY) {
+        memmove(state.history, state.history + 1, (GOVERNOR_HISTORY - 1) * sizeof(GovernorTransition));
+        state.history_count--;
+    }
+    state.history[state.history_count++] = (GovernorTransition) {mode, SDL_GetTicks(), reason};
+    state.mode = mode;
+    state.transitions++;
+}
+
+void governor_init(SDL_Window* window, SDL_Renderer* renderer) {
+    SDL_DisplayMode display;
+    int refresh = SDL_GetWindowDisplayMode(window, &display) == 0 ? display.refresh_rate : 0;
+    SDL_RendererInfo info;
+    bool vsync = SDL_GetRendererInfo(renderer, &info) == 0 && (info.flags & SDL_RENDERER_PRESENTVSYNC);
+
+    SDL_AtomicLock(&stats_lock);
+    memset(&state, 0, sizeof(state));
+    state.frame_ms = 1000.0 / (refresh > 0 ? refresh : 60);
+    state.vsync = vsync; // Off on the software fallback
+    state.vsync_control = vsync;
+    transition(GOVERNOR_IDLE, "startup");
+    SDL_AtomicUnlock(&stats_lock);
+}
+
+void governor_update(SDL_Renderer* renderer, bool drawing) {
+    GovernorMode mode = drawing ? GOVERNOR_DRAWING : GOVERNOR_IDLE;
+    if (mode == state.mode) return;
+
+    const char* reason = drawing ? "stroke started" : "stroke ended";
+    bool vsync = !drawing;
+    if (state.vsync_control && vsync != state.vsync) {
+        if (SDL_RenderSetVSync(renderer, vsync) == 0) {
+            state.vsync = vsync;
+        } else {
+            // Stays on vsync, drawing still skips the idle waits
+            printf("Can't switch vsync: %s\n", SDL_GetError());
+            state.vsync_control = false;
+            reason = drawing ? "stroke started, vsync can't be turned off" : "stroke ended";
+        }
+    }
+
+    SDL_AtomicLock(&stats_lock);
+    transition(mode, reason);
+    SDL_AtomicUnlock(&stats_lock);
+}
+
+void governor_presented(double draw_ms) {
+    int bucket = draw_ms / GOVERNOR_FRAME_BUCKET_MS;
+    if (bucket < 0) bucket = 0;
+    if (bucket >= GOVERNOR_FRAME_BUCKETS) bucket = GOVERNOR_FRAME_BUCKETS - 1;
+
+    SDL_AtomicLock(&stats_lock);
+    state.frames[state.mode]++;
+    state.frame_times[bucket]++;
+    SDL_AtomicUnlock(&stats_lock);
+}
+
+bool governor_vsync(void) {
+    return state.vsync;
+}
+
+double governor_frame_ms(void) {
+    return state.frame_ms;
+}
+
+Uint32 governor_wait_ms(void) {
+    // Drawing keeps the predicted and latched tip moving at the display rate
+    return state.mode == GOVERNOR_DRAWING ? (Uint32) state.frame_ms : GOVERNOR_IDLE_MS;
+}
+
+void governor_stats(GovernorStats* stats) {
+    SDL_AtomicLock(&stats_lock);
+    *stats = state;
+    SDL_AtomicUnlock(&stats_lock);
+}
+
+double governor_frame_percentile(const GovernorStats* stats, double p) {
+    Uint64 total = 0;
+    for (int i = 0; i < GOVERNOR_FRAME_BUCKETS; i++) total += stats -> frame_times[i];
+    if (total == 0) return 0;
+
+    Uint64 rank = (Uint64) (p * (total - 1)) + 1, seen = 0;
+    for (int i = 0; i < GOVERNOR_FRAME_BUCKETS; i++) {
+        seen += stats -> frame_times[i];
+        if (seen >= rank) return (i + 1) * GOVERNOR_FRAME_BUCKET_MS;
+    }
+    return GOVERNOR_FRAME_BUCKETS * GOVERNOR_FRAME_BUCKET_MS;
+}
+
+void governor_print_stats(void) {
+    GovernorStats stats;
+    governor_stats(&stats);
+
+    printf("Render: %s, vsync %s%s, %.1f ms frames\n", mode_name(stats.mode), stats.vsync ? "on" : "off",
+        stats.vsync_control ? "" : " (fixed by the renderer)", stats.frame_ms);
+    printf("  presents: %llu drawing, %llu idle; %llu transitions\n", (unsigned long long) stats.frames[GOVERNOR_DRAWING],
+        (unsigned long long) stats.frames[GOVERNOR_IDLE], (unsigned long long) stats.transitions);
+    printf("  frame time: p50 %.1f ms, p90 %.1f ms, p99 %.1f ms\n", governor_frame_percentile(&stats, 0.5),
+        governor_frame_percentile(&stats, 0.9), governor_frame_percentile(&stats, 0.99));
+    for (int i = 0; i < stats.history_count; i++) {
+        printf("  %8u ms -> %s: %s\n", stats.history[i].time, mode_name(stats.history[i].mode), stats.history[i].reason);
+    }
+}
@@ -0,0 +1,52 @@
+#ifndef GOVERNOR_H
+#define GOVERNOR_H
+
+#include <SDL2/SDL.h>
+#include <stdbool.h>
+
+#include "__macros.h"
+
+// Picks how the render thread presents. While a stroke is drawn frames go out
+// as soon as they're ready (vsync off where the renderer allows it); otherwise
+// frames are only drawn when a command arrives, with vsync on.
+
+typedef enum {
+    GOVERNOR_IDLE,
+    GOVERNOR_DRAWING,
+} GovernorMode;
+
+typedef struct {
+    GovernorMode mode;
+    Uint32 time; // SDL_GetTicks
+    const char* reason;
+} GovernorTransition;
+
+typedef struct {
+    GovernorMode mode;
+    bool vsync;
+    bool vsync_control; // false: the renderer keeps vsync on regardless
+    double frame_ms;    // Display refresh period
+    Uint64 frames[2];   // Presents per mode
+    Uint64 transitions;
+    GovernorTransition history[GOVERNOR_HISTORY]; // Newest last
+    int history_count;
+    Uint32 frame_times[GOVERNOR_FRAME_BUCKETS]; // Draw to present, GOVERNOR_FRAME_BUCKET_MS wide, the last one open ended
+} GovernorStats;
+
+// Render thread
+void governor_init(SDL_Window* window, SDL_Renderer* renderer);
+void governor_update(SDL_Renderer* renderer, bool drawing);
+// draw_ms: time from the start of drawing the frame to the end of present
+void governor_presented(double draw_ms);
+bool governor_vsync(void);
+double governor_frame_ms(void);
+// How long the render thread may sleep waiting for a command
+Uint32 governor_wait_ms(void);
+
+// Any thread
+void governor_stats(GovernorStats* stats);
+// Upper edge of the bucket holding the p-th frame time, 0 <= p <= 1
+double governor_frame_percentile(const GovernorStats* stats, double p);
+void governor_print_stats(void);
+
+#endif
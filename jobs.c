@@ -0,0 +1,229 @@
+#include <SDL2/SDL.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "__macros.h"
+#include "jobs.h"
+
+struct Job {
+    const char* name;
+    JobPriority priority;
+    JobFunction run, done;
+    void* data;
+    int waiting;   // Unfinished jobs it depends on
+    bool submitted;
+    Job* dependents[JOB_DEPENDENTS];
+    int dependent_count;
+    Job* next;     // Ready queue, then the undelivered list
+};
+
+Uint32 JOB_EVENT = (Uint32) -1;
+
+static SDL_mutex* jobs_lock = NULL;
+static SDL_cond* job_ready = NULL; // Workers wait on this
+static SDL_cond* jobs_idle = NULL; // Shutdown waits on this
+static Job* ready_head[JOB_PRIORITIES];
+static Job* ready_tail[JOB_PRIORITIES];
+static size_t unfinished = 0; // Submitted and not yet run
+// Finished jobs whose JOB_EVENT couldn't be posted, oldest first; their callbacks
+// run with the next dispatch or at shutdown
+static Job* undelivered_head = NULL;
+static Job* undelivered_tail = NULL;
+static bool workers_quit = false;
+
+static SDL_Thread* workers[JOB_MAX_WORKERS];
+static int worker_count = 0;
+
+// Called with jobs_lock held
+static void make_ready(Job* job) {
+    job -> next = NULL;
+    if (ready_tail[job -> priority]) {
+        ready_tail[job -> priority] -> next = job;
+    } else {
+        ready_head[job -> priority] = job;
+    }
+    ready_tail[job -> priority] = job;
+    SDL_CondSignal(job_ready);
+}
+
+// Called with jobs_lock held
+static Job* take_ready(void) {
+    for (int p = 0; p < JOB_PRIORITIES; p++) {
+        Job* job = ready_head[p];
+        if (!job) continue;
+        ready_head[p] = job -> next;
+        if (!ready_head[p]) ready_tail[p] = NULL;
+        return job;
+    }
+    return NULL;
+}
+
+static void finish(Job* job) {
+    SDL_LockMutex(jobs_lock);
+    for (int i = 0; i < job -> dependent_count; i++) {
+        Job* dependent = job -> dependents[i];
+        if (--dependent -> waiting == 0 && dependent -> submitted) make_ready(dependent);
+    }
+    if (--unfinished == 0) SDL_CondBroadcast(jobs_idle);
+    SDL_UnlockMutex(jobs_lock);
+
+    if (job -> done) {
+        SDL_Event event;
+        memset(&event, 0, sizeof(event));
+        event.type = JOB_EVENT;
+        event.user.data1 = job;
+        if (SDL_PushEvent(&event) > 0) return;
+
+        SDL_LockMutex(jobs_lock);
+        job -> next = NULL;
+        if (undelivered_tail) {
+            undelivered_tail -> next = job;
+        } else {
+            undelivered_head = job;
+        }
+        undelivered_tail = job;
+        SDL_UnlockMutex(jobs_lock);
+        return;
+    }
+    free(job);
+}
+
+// Event thread
+static void run_undelivered(void) {
+    SDL_LockMutex(jobs_lock);
+    Job* job = undelivered_head;
+    undelivered_head = undelivered_tail = NULL;
+    SDL_UnlockMutex(jobs_lock);
+
+    while (job) {
+        Job* next = job -> next;
+        job -> done(job -> data);
+        free(job);
+        job = next;
+    }
+}
+
+static int worker(void* data) {
+    (void) data;
+
+    SDL_LockMutex(jobs_lock);
+    while (true) {
+        Job* job;
+        while (!(job = take_ready()) && !workers_quit) {
+            SDL_CondWait(job_ready, jobs_lock);
+        }
+        // Everything submitted has run by the time workers_quit is set
+        if (!job) break;
+        SDL_UnlockMutex(jobs_lock);
+
+        job -> run(job -> data);
+        finish(job);
+
+        SDL_LockMutex(jobs_lock);
+    }
+    SDL_UnlockMutex(jobs_lock);
+    return 0;
+}
+
+bool jobs_init(void) {
+    JOB_EVENT = SDL_RegisterEvents(1);
+    jobs_lock = SDL_CreateMutex();
+    job_ready = SDL_CreateCond();
+    jobs_idle = SDL_CreateCond();
+    if (JOB_EVENT == (Uint32) -1 || !jobs_lock || !job_ready || !jobs_idle) {
+        printf("Couldn't set up jobs: %s\n", SDL_GetError());
+        return false;
+    }
+
+    int count = SDL_GetCPUCount();
+    if (count < 1) count = 1;
+    if (count > JOB_MAX_WORKERS) count = JOB_MAX_WORKERS;
+
+    workers_quit = false;
+    for (worker_count = 0; worker_count < count; worker_count++) {
+        workers[worker_count] = SDL_CreateThread(worker, "job", NULL);
+        if (!workers[worker_count]) {
+            printf("Couldn't start job worker: %s\n", SDL_GetError());
+            break;
+        }
+    }
+    return worker_count > 0;
+}
+
+void jobs_shutdown(void) {
+    if (!jobs_lock) return;
+
+    SDL_LockMutex(jobs_lock);
+    while (unfinished > 0 && worker_count > 0) SDL_CondWait(jobs_idle, jobs_lock);
+    workers_quit = true;
+    SDL_CondBroadcast(job_ready);
+    SDL_UnlockMutex(jobs_lock);
+
+    for (int i = 0; i < worker_count; i++) {
+        SDL_WaitThread(workers[i], NULL);
+    }
+    worker_count = 0;
+
+    // Callbacks of jobs that finished after the event loop stopped dispatching
+    SDL_Event events[16];
+    int count;
+    while ((count = SDL_PeepEvents(events, SDL_arraysize(events), SDL_GETEVENT, JOB_EVENT, JOB_EVENT)) > 0) {
+        for (int i = 0; i < count; i++) jobs_dispatch(&events[i]);
+    }
+    run_undelivered();
+
+    SDL_DestroyCond(jobs_idle);
+    SDL_DestroyCond(job_ready);
+    SDL_DestroyMutex(jobs_lock);
+    jobs_idle = job_ready = NULL;
+    jobs_lock = NULL;
+}
+
+Job* job_create(const char* name, JobPriority priority, JobFunction run, JobFunction done, void* data) {
+    Job* job = calloc(1, sizeof(Job));
+    if (!job) {
+        fprintf(stderr, "Memory allocation failed!\n");
+        exit(1);
+    }
+    job -> name = name;
+    job -> priority = priority;
+    job -> run = run;
+    job -> done = done;
+    job -> data = data;
+    return job;
+}
+
+void job_after(Job* job, Job* first) {
+    if (first -> dependent_count == JOB_DEPENDENTS) {
+        printf("%s has too many dependents, %s won't wait for it\n", first -> name, job -> name);
+        return;
+    }
+    first -> dependents[first -> dependent_count++] = job;
+    job -> waiting++; // Neither is submitted yet, so no lock needed
+}
+
+void job_submit(Job* job) {
+    if (worker_count == 0) {
+        // Dependencies are honoured by submit order here
+        job -> run(job -> data);
+        if (job -> done) job -> done(job -> data);
+        free(job);
+        return;
+    }
+
+    SDL_LockMutex(jobs_lock);
+    job -> submitted = true;
+    unfinished++;
+    if (job -> waiting == 0) make_ready(job);
+    SDL_UnlockMutex(jobs_lock);
+}
+
+void jobs_dispatch(const SDL_Event* event) {
+    run_undelivered(); // They finished before this one
+    Job* job = event -> user.data1;
+    job -> done(job -> data);
+    free(job);
+}
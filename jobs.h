@@ -0,0 +1,44 @@
+#ifndef JOBS_H
+#define JOBS_H
+
+#include <SDL2/SDL.h>
+#include <stdbool.h>
+
+// Fixed pool of worker threads, one per core, shared by every kind of background
+// CPU work. Jobs run highest priority first, oldest first within a priority, and
+// only once the jobs they depend on have finished. A completion callback runs on
+// the event thread when it dispatches the JOB_EVENT posted for it.
+//
+// A job must not wait for another job: every worker could end up waiting.
+
+typedef enum {
+    JOB_HIGH,   // The user is waiting on it
+    JOB_NORMAL,
+    JOB_LOW,    // Housekeeping
+    JOB_PRIORITIES,
+} JobPriority;
+
+typedef void (*JobFunction)(void* data);
+
+typedef struct Job Job;
+
+// event.user.data1: the finished job, pass the event to jobs_dispatch
+extern Uint32 JOB_EVENT;
+
+bool jobs_init(void);
+// Runs everything submitted, stops the workers, then runs the callbacks still queued
+void jobs_shutdown(void);
+
+// done may be NULL; otherwise it runs with data on the event thread afterwards.
+// The job is freed once it finished and its callback ran.
+Job* job_create(const char* name, JobPriority priority, JobFunction run, JobFunction done, void* data);
+// job starts only after first finished. Call before submitting either.
+void job_after(Job* job, Job* first);
+// Without workers the job runs right here
+void job_submit(Job* job);
+
+// Event thread: runs the callback of a JOB_EVENT, after those of earlier jobs
+// whose JOB_EVENT couldn't be posted
+void jobs_dispatch(const SDL_Event* event);
+
+#endif
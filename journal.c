@@ -0,0 +1,452 @@
+#include <SDL2/SDL.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+
+#include "__macros.h"
+#include "journal.h"
+
+typedef enum {
+    RECORD_POINT = 1,       // x, y (Sint32), thickness (Uint16), connect (Uint8)
+    RECORD_TEXT = 2,        // character
+    RECORD_POP = 3,
+    RECORD_CLEAR_POINTS = 4,
+    RECORD_CLEAR_TEXT = 5,
+    RECORD_BASE = 6,        // length (Uint16), what the board was loaded from
+    RECORD_CHECKPOINT = 7,  // edits (Uint64), length (Uint16), the file they were saved to
+} RecordType;
+
+#define POINT_RECORD_SIZE 12
+
+// Each flush is one frame, so a torn write at a crash only loses its own frame
+typedef struct {
+    Uint32 length;
+    Uint32 checksum;
+} FrameHeader;
+
+static char journal_path[1024];
+static int journal_fd = -1;
+static off_t journal_size = 0; // Whole frames in the file, a failed write is cut back to it
+static bool journal_running = false;
+
+// Input side appends to front; the flusher swaps it with back and writes back
+static SDL_SpinLock journal_lock = 0;
+static Uint8 *front = NULL, *back = NULL;
+static size_t front_len = 0, front_capacity = 0, back_capacity = 0;
+static bool flush_requested = false;
+
+// Edit records in the file and since; a checkpoint refers to a count of them
+static Uint64 journal_edits = 0;
+static Uint64 recovered_edits = 0;
+
+static SDL_sem* wake = NULL;
+static SDL_Thread* flusher = NULL;
+static SDL_atomic_t flusher_quit;
+
+// FNV-1a, only needs to catch torn and partial frames
+static Uint32 checksum(const Uint8* data, size_t len) {
+    Uint32 hash = 2166136261u;
+    for (size_t i = 0; i < len; i++) {
+        hash = (hash ^ data[i]) * 16777619u;
+    }
+    return hash;
+}
+
+static void append(const Uint8* record, size_t len, bool edit) {
+    if (!journal_running) return;
+
+    bool kick = false;
+    SDL_AtomicLock(&journal_lock);
+    if (front_len + len > front_capacity) {
+        // Only when the flusher fell behind; keep the record rather than block
+        size_t capacity = front_capacity * 2 + len;
+        Uint8* temp = realloc(front, capacity);
+        if (!temp) {
+            SDL_AtomicUnlock(&journal_lock);
+            return;
+        }
+        front = temp;
+        front_capacity = capacity;
+    }
+    memcpy(front + front_len, record, len);
+    front_len += len;
+    if (edit) journal_edits++;
+    if (front_len >= JOURNAL_FLUSH_BYTES && !flush_requested) {
+        flush_requested = kick = true;
+    }
+    SDL_AtomicUnlock(&journal_lock);
+
+    if (kick) SDL_SemPost(wake);
+}
+
+void journal_point(int x, int y, int line_thickness, bool connect) {
+    Uint8 record[POINT_RECORD_SIZE];
+    Sint32 px = x, py = y;
+    Uint16 thickness = line_thickness < 0 ? 0 : line_thickness > 0xFFFF ? 0xFFFF : line_thickness;
+
+    record[0] = RECORD_POINT;
+    memcpy(record + 1, &px, 4);
+    memcpy(record + 5, &py, 4);
+    memcpy(record + 9, &thickness, 2);
+    record[11] = connect;
+    append(record, sizeof(record), true);
+}
+
+void journal_text(char key_value) {
+    Uint8 record[2] = {RECORD_TEXT, (Uint8) key_value};
+    append(record, sizeof(record), true);
+}
+
+void journal_pop(void) {
+    Uint8 record = RECORD_POP;
+    append(&record, 1, true);
+}
+
+void journal_clear_points(void) {
+    Uint8 record = RECORD_CLEAR_POINTS;
+    append(&record, 1, true);
+}
+
+void journal_clear_text(void) {
+    Uint8 record = RECORD_CLEAR_TEXT;
+    append(&record, 1, true);
+}
+
+Uint64 journal_position(void) {
+    SDL_AtomicLock(&journal_lock);
+    Uint64 position = journal_edits;
+    SDL_AtomicUnlock(&journal_lock);
+    return position;
+}
+
+// Type, then the path with a length prefix; the checkpoint also carries the edit count
+static size_t path_record(Uint8* record, RecordType type, Uint64 edits, const char* path) {
+    size_t path_len = SDL_min(strlen(path), JOURNAL_PATH_MAX);
+    Uint16 length = path_len;
+    size_t i = 0;
+    record[i++] = type;
+    if (type == RECORD_CHECKPOINT) {
+        memcpy(record + i, &edits, 8);
+        i += 8;
+    }
+    memcpy(record + i, &length, 2);
+    i += 2;
+    memcpy(record + i, path, path_len);
+    return i + path_len;
+}
+
+void journal_checkpoint(Uint64 position, const char* base) {
+    Uint8 record[1 + 8 + 2 + JOURNAL_PATH_MAX];
+    append(record, path_record(record, RECORD_CHECKPOINT, position, base), false);
+}
+
+static bool write_frame(const Uint8* batch, size_t batch_len) {
+    FrameHeader header = {(Uint32) batch_len, checksum(batch, batch_len)};
+    struct iovec parts[2] = {
+        {&header, sizeof(header)},
+        {(void*) batch, batch_len},
+    };
+    ssize_t expected = sizeof(header) + batch_len;
+    ssize_t written = writev(journal_fd, parts, 2);
+    if (written != expected || fdatasync(journal_fd) != 0) {
+        printf("Journal write failed: %s\n", written >= 0 && written < expected ? "short write" : strerror(errno));
+        // Whatever part of the frame got in goes, so the retry starts on a frame boundary
+        if (ftruncate(journal_fd, journal_size) != 0) {
+            printf("Couldn't cut back the journal: %s\n", strerror(errno));
+        }
+        return false;
+    }
+    journal_size += expected;
+    return true;
+}
+
+static void flush_pending(void) {
+    SDL_AtomicLock(&journal_lock);
+    Uint8* batch = front;
+    size_t batch_len = front_len, batch_capacity = front_capacity;
+    front = back;
+    front_capacity = back_capacity;
+    front_len = 0;
+    back = batch;
+    back_capacity = batch_capacity;
+    flush_requested = false;
+    SDL_AtomicUnlock(&journal_lock);
+
+    if (batch_len == 0 || write_frame(batch, batch_len)) return;
+
+    // Retried with the next flush, ahead of what was appended meanwhile
+    SDL_AtomicLock(&journal_lock);
+    bool kept = true;
+    if (batch_len + front_len > batch_capacity) {
+        size_t capacity = batch_len + front_len + JOURNAL_FLUSH_BYTES;
+        Uint8* temp = realloc(batch, capacity);
+        if (temp) {
+            batch = temp;
+            batch_capacity = capacity;
+        } else {
+            kept = false;
+        }
+    }
+    if (kept) {
+        memcpy(batch + batch_len, front, front_len);
+        back = front;
+        back_capacity = front_capacity;
+        front = batch;
+        front_capacity = batch_capacity;
+        front_len += batch_len;
+    } else {
+        back = batch;
+    }
+    SDL_AtomicUnlock(&journal_lock);
+
+    if (!kept) printf("Journal dropped %zu bytes of edits\n", batch_len);
+}
+
+static int flush_loop(void* data) {
+    (void) data;
+    while (!SDL_AtomicGet(&flusher_quit)) {
+        SDL_SemWaitTimeout(wake, JOURNAL_FLUSH_MS);
+        flush_pending();
+    }
+    flush_pending();
+    return 0;
+}
+
+bool journal_start(const char* path, const char* base) {
+    snprintf(journal_path, sizeof(journal_path), "%s", path);
+    journal_fd = open(journal_path, O_WRONLY | O_CREAT | O_APPEND, 0600);
+    if (journal_fd < 0) {
+        printf("Couldn't open journal %s: %s\n", journal_path, strerror(errno));
+        return false;
+    }
+
+    // A new journal starts with what its edits apply to; a recovered one keeps its own
+    struct stat st;
+    journal_size = fstat(journal_fd, &st) == 0 ? st.st_size : lseek(journal_fd, 0, SEEK_END);
+    if (journal_size == 0) {
+        Uint8 record[1 + 2 + JOURNAL_PATH_MAX];
+        write_frame(record, path_record(record, RECORD_BASE, 0, base));
+        recovered_edits = 0;
+    }
+    journal_edits = recovered_edits;
+
+    front_capacity = back_capacity = JOURNAL_FLUSH_BYTES * 2;
+    front = malloc(front_capacity);
+    back = malloc(back_capacity);
+    wake = SDL_CreateSemaphore(0);
+    if (!front || !back || !wake) {
+        printf("Couldn't start journal\n");
+        close(journal_fd);
+        journal_fd = -1;
+        return false;
+    }
+
+    SDL_AtomicSet(&flusher_quit, 0);
+    flusher = SDL_CreateThread(flush_loop, "journal", NULL);
+    if (!flusher) {
+        printf("Couldn't start journal thread: %s\n", SDL_GetError());
+        close(journal_fd);
+        journal_fd = -1;
+        return false;
+    }
+    journal_running = true;
+    return true;
+}
+
+void journal_shutdown(bool clean_exit) {
+    if (!journal_running) return;
+    journal_running = false;
+
+    SDL_AtomicSet(&flusher_quit, 1);
+    SDL_SemPost(wake);
+    SDL_WaitThread(flusher, NULL);
+    flusher = NULL;
+
+    close(journal_fd);
+    journal_fd = -1;
+    if (clean_exit) unlink(journal_path);
+
+    SDL_DestroySemaphore(wake);
+    wake = NULL;
+    free(front);
+    free(back);
+    front = back = NULL;
+    front_len = front_capacity = back_capacity = 0;
+}
+
+// What a journal applies to: its base, or the file of its latest checkpoint and
+// how many of its edits that file already holds
+typedef struct {
+    char base[JOURNAL_PATH_MAX + 1];
+    bool has_base;
+    Uint64 saved_edits;
+    Uint64 edits;
+} JournalScan;
+
+static bool read_path(const Uint8* data, size_t len, size_t* i, char* out) {
+    Uint16 length;
+    if (*i + 2 > len) return false;
+    memcpy(&length, data + *i, 2);
+    if (length > JOURNAL_PATH_MAX || *i + 2 + length > len) return false;
+    memcpy(out, data + *i + 2, length);
+    out[length] = '\0';
+    *i += 2 + length;
+    return true;
+}
+
+// Without replay only scans; with it applies the edits past scan -> saved_edits
+static bool replay_frame(const Uint8* data, size_t len, JournalScan* scan, const JournalReplay* replay) {
+    size_t i = 0;
+    while (i < len) {
+        RecordType type = data[i];
+        bool apply = replay && scan -> edits >= scan -> saved_edits;
+        switch (type) {
+            case RECORD_POINT: {
+                if (i + POINT_RECORD_SIZE > len) return false;
+                Sint32 x, y;
+                Uint16 thickness;
+                memcpy(&x, data + i + 1, 4);
+                memcpy(&y, data + i + 5, 4);
+                memcpy(&thickness, data + i + 9, 2);
+                if (apply) replay -> point(x, y, thickness, data[i + 11] != 0);
+                i += POINT_RECORD_SIZE;
+                break;
+            }
+            case RECORD_TEXT:
+                if (i + 2 > len) return false;
+                if (apply) replay -> text((char) data[i + 1]);
+                i += 2;
+                break;
+            case RECORD_POP:
+                if (apply) replay -> pop();
+                i++;
+                break;
+            case RECORD_CLEAR_POINTS:
+                if (apply) replay -> clear_points();
+                i++;
+                break;
+            case RECORD_CLEAR_TEXT:
+                if (apply) replay -> clear_text();
+                i++;
+                break;
+            case RECORD_BASE: {
+                char base[JOURNAL_PATH_MAX + 1];
+                i++;
+                if (!read_path(data, len, &i, base)) return false;
+                if (!replay) {
+                    memcpy(scan -> base, base, sizeof(base));
+                    scan -> has_base = true;
+                }
+                continue;
+            }
+            case RECORD_CHECKPOINT: {
+                char base[JOURNAL_PATH_MAX + 1];
+                Uint64 saved;
+                if (i + 9 > len) return false;
+                memcpy(&saved, data + i + 1, 8);
+                i += 9;
+                if (!read_path(data, len, &i, base)) return false;
+                // A save that finished late can hold fewer edits than an earlier one
+                if (!replay && saved >= scan -> saved_edits) {
+                    memcpy(scan -> base, base, sizeof(base));
+                    scan -> has_base = true;
+                    scan -> saved_edits = saved;
+                }
+                continue;
+            }
+            default:
+                return false; // Checksum passed but the contents don't make sense
+        }
+        scan -> edits++;
+    }
+    return true;
+}
+
+// Walks the good frames, trimming a torn tail so new frames follow the last good one
+static bool replay_file(const char* path, JournalScan* scan, const JournalReplay* replay) {
+    int fd = open(path, O_RDWR);
+    if (fd < 0) return false;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        close(fd);
+        return false;
+    }
+
+    Uint8* data = malloc(st.st_size);
+    if (!data || pread(fd, data, st.st_size, 0) != st.st_size) {
+        free(data);
+        close(fd);
+        return false;
+    }
+
+    scan -> edits = 0;
+    size_t offset = 0;
+    while (offset + sizeof(FrameHeader) <= (size_t) st.st_size) {
+        FrameHeader header;
+        memcpy(&header, data + offset, sizeof(header));
+        size_t end = offset + sizeof(header) + header.length;
+        if (end > (size_t) st.st_size || checksum(data + offset + sizeof(header), header.length) != header.checksum) {
+            break; // Torn by the crash; everything after it is lost anyway
+        }
+        bool whole = replay_frame(data + offset + sizeof(header), header.length, scan, replay);
+        offset = end;
+        if (!whole) break;
+    }
+
+    if (offset < (size_t) st.st_size && ftruncate(fd, offset) != 0) {
+        printf("Couldn't trim journal: %s\n", strerror(errno));
+    }
+
+    free(data);
+    close(fd);
+    return true;
+}
+
+// Journals from before the base record apply to anything
+static bool replay_matching(const char* path, const char* base, const JournalReplay* replay, size_t* replayed) {
+    JournalScan scan = {0};
+    if (!replay_file(path, &scan, NULL)) return false;
+    if (scan.has_base && strncmp(scan.base, base, JOURNAL_PATH_MAX) != 0) {
+        if (scan.base[0]) printf("A crashed session's edits to %s are kept until it is opened again\n", scan.base);
+        else printf("A crashed session's edits are kept until Scratch Pad is started without a file\n");
+        return false;
+    }
+
+    replay_file(path, &scan, replay);
+    recovered_edits = scan.edits;
+    *replayed = scan.edits - SDL_min(scan.saved_edits, scan.edits);
+    return true;
+}
+
+size_t journal_replay(const char* path, const char* base, const JournalReplay* replay) {
+    char unrecovered[1024 + sizeof(JOURNAL_UNRECOVERED)], other[1024 + sizeof(JOURNAL_UNRECOVERED) + 4];
+    snprintf(unrecovered, sizeof(unrecovered), "%s%s", path, JOURNAL_UNRECOVERED);
+    snprintf(other, sizeof(other), "%s.tmp", unrecovered);
+    recovered_edits = 0;
+
+    size_t replayed = 0;
+    bool crashed = access(path, F_OK) == 0;
+    if (crashed && replay_matching(path, base, replay, &replayed)) return replayed;
+
+    // A journal of another board is kept aside until that board is opened,
+    // and the one kept aside earlier may be this board's
+    if (crashed && rename(path, other) != 0) {
+        printf("Couldn't keep the journal: %s\n", strerror(errno));
+        crashed = false;
+    }
+    if (access(unrecovered, F_OK) == 0 && replay_matching(unrecovered, base, replay, &replayed)) {
+        if (rename(unrecovered, path) != 0) {
+            printf("Couldn't restore the journal: %s\n", strerror(errno));
+        }
+    }
+    if (crashed) rename(other, unrecovered);
+    return replayed;
+}
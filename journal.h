@@ -0,0 +1,47 @@
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#include <SDL2/SDL.h>
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// Write ahead journal of every edit since launch, so a crash loses at most
+// JOURNAL_FLUSH_MS of work. Appending only copies a few bytes into memory;
+// a background thread writes and fdatasyncs whole batches (group commit).
+
+typedef struct {
+    void (*point)(int x, int y, int line_thickness, bool connect);
+    void (*text)(char key_value);
+    void (*pop)(void);
+    void (*clear_points)(void);
+    void (*clear_text)(void);
+} JournalReplay;
+
+// Applies a journal left behind by a session that didn't exit cleanly, from
+// its last checkpoint on. base names what the board was loaded from ("" for
+// none); a journal of another base is kept aside rather than replayed.
+// Call before journal_start so the replayed edits aren't journaled again.
+// Returns the number of records replayed.
+size_t journal_replay(const char* path, const char* base, const JournalReplay* replay);
+
+bool journal_start(const char* path, const char* base);
+
+// Edits journaled so far; take it with the snapshot a save writes
+Uint64 journal_position(void);
+
+// The save of the board at position to base succeeded, so a crash after it
+// only replays later edits, and only onto that file
+void journal_checkpoint(Uint64 position, const char* base);
+
+// Flushes what is left; a clean exit also removes the file
+void journal_shutdown(bool clean_exit);
+
+// Cheap enough to call from the input path; no-ops until journal_start
+void journal_point(int x, int y, int line_thickness, bool connect);
+void journal_text(char key_value);
+void journal_pop(void);
+void journal_clear_points(void);
+void journal_clear_text(void);
+
+#endif
@@ -11,28 +11,107 @@
 #include <stdbool.h>
 
 #include <string.h>
+#include <limits.h>
+#include <unistd.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <wchar.h>
 
 #include "__macros.h"
 #include "__struct.h"
+#include "export.h"
+#include "vector.h"
+#include "document.h"
+#include "csv.h"
+#include "journal.h"
+#include "snapshot.h"
+#include "render_queue.h"
+#include "predictor.h"
+#include "governor.h"
+#include "scheduler.h"
+#include "jobs.h"
+#include "recorder.h"
 
 void addPoint(int x, int y, int line_thickness, bool connect);
+void addPoints(const SDL_Point* samples, size_t count, int line_thickness, bool connect);
+size_t drainMotion(SDL_Event* events, int max);
+void addToStroke(size_t index);
+void clearPoints();
+void rebuildStrokes();
+void adoptDocument(ScratchDocument* doc);
+void boardBase(const char* path, char* base);
+Snapshot* snapshotBoard();
+
+// Parameters of a save or export that runs on a snapshot of the board
+typedef struct {
+    bool full_save;
+    Uint64 journal_position;
+    CanvasExport canvas;
+    VectorExport vector;
+    VectorFormat format;
+} BoardTask;
+
+void runBoardTask(const char* name, Snapshot* snapshot, SnapshotTask task, BoardTask params);
+void saveDocumentTask(Snapshot* snapshot, void* data);
+void exportCanvasTask(Snapshot* snapshot, void* data);
+void exportCanvasFinished(void* data);
+void exportVectorTask(Snapshot* snapshot, void* data);
+void exportCSVTask(Snapshot* snapshot, void* data);
+
+// Handed to the render thread at startup
+typedef struct {
+    SDL_Window* window;
+    const ScratchDocument* warm; // Shown in the first frame, may be NULL
+    char warm_path[1024];
+    SDL_sem* ready; // Posted once the renderer and the font are up, or failed
+    bool running;
+} RenderStart;
+
+// Finished strokes drawn at full quality into a texture that outlives frames. Strokes
+// only ever get appended, so it stays valid until the board, colors or size change.
+typedef struct {
+    SDL_Texture* texture;
+    int width, height;
+    Uint32 board;
+    bool dark_mode;
+    size_t* order;       // Visible finished strokes, nearest to the window centre first
+    size_t ordered, order_capacity;
+    size_t considered;   // Strokes [0, considered) are in order, or off screen
+    size_t refined;      // order[0, refined) are in the texture
+    double segment_cost; // ns per anti aliased segment, measured
+    double preview_cost; // ns per segment of the cheap pass, measured
+} RetainedCanvas;
+
+int RenderThread(void* data);
+bool sendRenderCommand(bool dark_mode, bool highlight, int font_size, int window_width, RenderCommand command);
+void LateLatch(SDL_Renderer* renderer, RenderView* view, Uint64 last_present, double frame_ms);
+void RenderPrediction(SDL_Renderer* renderer, const RenderView* view, double frame_ms);
+void ExportBoardCanvas(TTF_Font* font, const RenderView* view, int scale);
+void ExportBoardVector(TTF_Font* font, const RenderView* view, VectorFormat format);
 void RenderPoint(SDL_Renderer* renderer, Point p1, Point p2, SDL_Color color);
-void ReRenderAllPoints(SDL_Renderer* renderer);
+size_t RenderStrokes(SDL_Renderer* renderer, const Snapshot* board, const size_t* order, size_t first, size_t last, int width, int height, bool cheap);
+size_t CountSegments(const Snapshot* board, const size_t* order, size_t first, size_t last, int width, int height);
+void OrderStrokes(RetainedCanvas* canvas, const Snapshot* board, size_t frozen);
+void RenderStrokePreview(SDL_Renderer* renderer, const Snapshot* board, size_t s);
+void RenderSegmentStrip(SDL_Renderer* renderer, const Point* line, size_t count, SDL_Color color);
+bool RenderBoard(SDL_Renderer* renderer, RetainedCanvas* canvas, const RenderView* view, bool exact);
+void RenderCachedCanvas(SDL_Renderer* renderer, const ScratchDocument* doc);
+bool SaveWarmCache(SDL_Renderer* renderer, const char* path, const Snapshot* board);
 
 void add_user_input(char key_value);
 void pop_user_input();
-void RenderText(SDL_Renderer *renderer, TTF_Font *font, const char *text, int window_width, bool highlight);
+void clear_user_input();
+void RenderText(SDL_Renderer *renderer, TTF_Font *font, const char *text, int window_width, bool highlight, bool caret);
+SDL_Surface* RenderTextSurface(TTF_Font *font, const char *text, int max_width, SDL_Color txt_color, SDL_Color bg_color, bool highlight, bool caret);
 void RenderIcons(SDL_Renderer* renderer, SDL_Texture* texture, size_t x, size_t y, size_t w, size_t h, SDL_Color color);
 
-bool blinker_toggle_state();
+void toggleCaret(void* data);
+void blinkCaret(int caret_timer, bool typing, bool* view_changed);
+void hideCursor(void* data);
 
 // Helper Functions:
 void setPixel(SDL_Renderer* renderer, int x, int y, Uint8 r, Uint8 g, Uint8 b, Uint8 a, float intensity);
 void better_line(SDL_Renderer* renderer, int x1, int y1, int x2, int y2, int thickness);
-void SaveAsImage(SDL_Renderer* renderer);
 char* replace(const char* str, const char* old_substr, const char* new_substr);
 char* append_string(char *s1, char *s2);
 
@@ -54,16 +133,34 @@ size_t total_icons = 0;
 Point* points = NULL;
 size_t pointCount = 0;
 size_t pointCapacity = 0;
+SharedArray* point_store = NULL; // Owns points, shared with snapshots read by background saves
+
+// Strokes over points, kept up to date by addPoint
+Stroke* strokes = NULL;
+size_t strokeCount = 0;
+size_t strokeCapacity = 0;
+SharedArray* stroke_store = NULL;
+Uint32 board_generation = 0; // Bumped when strokes are removed, see RenderView.board
+
+ScratchDocument open_document; // Keeps the mapping of the file the board was opened from
+const char* document_path = FOLDER "drawing.scratch";
 
 char* usr_inputs = NULL;  // Dynamic string to store user input characters
 size_t usr_inputs_len = 0; // Current length (number of characters stored, excluding the null terminator)
 size_t usr_inputs_capacity = 0; // Capacity of the usr_inputs array
 
+// Owned by the event thread, sent along with every view
+bool low_latency = false; // CTRL + L: stroke tip drawn from the newest input just before present
+bool predict_motion = false; // CTRL + M: provisional tip extrapolated from pointer_motion
+Predictor pointer_motion; // Samples of the stroke being drawn
+bool caret_visible = false; // Flipped by the "caret" timer
+
 // Colors:
 SDL_Color text_color;
 SDL_Color background_color;
 
-int main(void) {
+#ifndef SCRATCH_BENCH // bench.c brings its own main
+int main(int argc, char** argv) {
     // Initialize SDL
     if (SDL_Init(SDL_INIT_VIDEO) < 0) {
         printf("SDL could not initialize! SDL_Error: %s\n", SDL_GetError());
@@ -89,36 +186,109 @@ int main(void) {
         return 1;
     }
 
-    // Create a renderer
-    SDL_Renderer* renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_ACCELERATED | SDL_RENDERER_PRESENTVSYNC);
-    if (renderer == NULL) {
-        printf("Renderer could not be created! SDL_Error: %s\n", SDL_GetError());
+    // --record file and --replay file [--fast] are for performance runs, anything else is the file to open
+    const char *open_path = NULL, *record_path = NULL, *replay_path = NULL;
+    bool replay_fast = false;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--record") == 0 && i + 1 < argc) record_path = argv[++i];
+        else if (strcmp(argv[i], "--replay") == 0 && i + 1 < argc) replay_path = argv[++i];
+        else if (strcmp(argv[i], "--fast") == 0) replay_fast = true;
+        else open_path = argv[i];
+    }
+
+    // Per user files: the crash journal and the warm start cache
+    RenderStart render = {.window = window, .warm_path = WARM_CACHE_FILE};
+    char journal_path[1024] = JOURNAL_FILE;
+    char* pref_path = SDL_GetPrefPath("KenniBlank", "Scratch Pad");
+    if (pref_path) {
+        snprintf(journal_path, sizeof(journal_path), "%s%s", pref_path, JOURNAL_FILE);
+        snprintf(render.warm_path, sizeof(render.warm_path), "%s%s", pref_path, WARM_CACHE_FILE);
+        SDL_free(pref_path);
+    }
+    // A replay starts from the same empty (or opened) board every time, and leaves the user's session alone
+    if (replay_path) render.warm_path[0] = '\0';
+
+    // Without a file to open, the first frame is the last session's board, straight from the mapping
+    bool warm_start = !open_path && render.warm_path[0] && access(render.warm_path, F_OK) == 0 && document_open_cache(render.warm_path, &open_document);
+    if (warm_start) render.warm = &open_document;
+
+    // The render thread owns the renderer and the font, this thread only handles input.
+    // It presents the first frame while the board is loaded here.
+    render.ready = SDL_CreateSemaphore(0);
+    SDL_Thread* render_thread = render.ready ? SDL_CreateThread(RenderThread, "render", &render) : NULL;
+    if (!render_thread) {
+        printf("Render thread could not be created! SDL_Error: %s\n", SDL_GetError());
         SDL_DestroyWindow(window);
         SDL_Quit();
         return 1;
     }
-
-    // Setup
-    SDL_SetRenderDrawBlendMode(renderer, SDL_BLENDMODE_BLEND); // Blending mode enabled
-    SDL_SetRenderDrawColor(renderer, unpack_color(background_color)); // First look color
-    SDL_RenderClear(renderer);
-    SDL_RenderPresent(renderer);
     IMG_Init(IMG_INIT_PNG);
 
-    int font_size = FONT_SIZE;
-    TTF_Font *font = TTF_OpenFont(FontLocation, font_size); // Load the font with the fixed size
-    if (!font) {
-        printf("Font loading failed: %s\n", TTF_GetError());
-        return 1;
+    if (!jobs_init()) {
+        printf("Background work runs on this thread\n");
+    }
+    if (!export_init()) {
+        printf("Saving images is disabled\n");
+    }
+    document_init();
+    snapshot_init();
+
+    // ./Scratch\ Pad drawing.scratch opens a saved board, a .csv file is imported as points
+    if (open_path) {
+        size_t len = strlen(open_path);
+        if (len > 4 && strcmp(open_path + len - 4, ".csv") == 0) {
+            size_t count;
+            Point* imported = ImportCSV(open_path, &count);
+            if (imported) {
+                clearPoints();
+                point_store = shared_wrap(imported, false);
+                points = imported;
+                pointCount = pointCapacity = count;
+                rebuildStrokes();
+                printf("Imported %zu points\n", count);
+            }
+        } else {
+            document_path = open_path;
+            // Adopting starts the next board generation
+            if (access(document_path, F_OK) == 0 && document_open(document_path, &open_document, board_generation + 1)) {
+                adoptDocument(&open_document);
+            }
+        }
+    }
+
+    // The points behind the cached frame, used in place until the first edit
+    if (warm_start) adoptDocument(&open_document);
+
+    // Edits of a session that crashed are replayed on top of what was opened, if it is the same board
+    if (!replay_path) {
+        char base[JOURNAL_PATH_MAX + 1] = "";
+        if (open_path) boardBase(open_path, base);
+        JournalReplay replay = {addPoint, add_user_input, pop_user_input, clearPoints, clear_user_input};
+        size_t recovered = journal_replay(journal_path, base, &replay);
+        if (recovered) {
+            printf("Recovered %zu edits from the last session\n", recovered);
+        }
+        journal_start(journal_path, base);
     }
 
+    SDL_SemWait(render.ready);
+    if (!render.running) {
+        SDL_WaitThread(render_thread, NULL);
+        return 1;
+    }
+    int font_size = FONT_SIZE;
 
+    // Created once, switching only changes which one is active
     SDL_Cursor* DEFAULT_CURSOR = SDL_CreateSystemCursor(SDL_SYSTEM_CURSOR_ARROW);
-    SDL_Cursor* cursor = SDL_CreateSystemCursor(SDL_SYSTEM_CURSOR_WAIT);
+    SDL_Cursor* CROSSHAIR_CURSOR = SDL_CreateSystemCursor(SDL_SYSTEM_CURSOR_CROSSHAIR);
+    SDL_Cursor* WAIT_CURSOR = SDL_CreateSystemCursor(SDL_SYSTEM_CURSOR_WAIT);
+    SDL_Cursor* cursor = WAIT_CURSOR;
     SDL_SetCursor(cursor);
 
     // Main loop
     SDL_Event event;
+    SDL_Event motion[MOTION_BATCH]; // Motion events taken from the queue in one go
+    SDL_Point samples[MOTION_BATCH];
 
     // Essential Variables definition
     bool app_running = true;
@@ -128,11 +298,9 @@ int main(void) {
     bool eraserMode = false;
 
     size_t line_thickness = 2;
+    int export_scale = 1; // Supersampling used by CTRL + F
     int window_width = WINDOW_WIDTH, window_height = WINDOW_HEIGHT;
 
-    text_color = DarkMode? (SDL_Color) {255, 255, 255, 255}: (SDL_Color) {0, 0, 0, 255};
-    background_color = DarkMode? (SDL_Color) {0, 0, 0, 255}: (SDL_Color) {255, 255, 255, 255};
-
     SDL_StartTextInput(); // Enable text input
 
     bool ctrlA_pressed = false;
@@ -141,18 +309,28 @@ int main(void) {
     SDL_SetCursor(cursor);
     bool cursorVisible = true;
     SDL_ShowCursor(cursorVisible);
-    uint32_t lastActivity = SDL_GetTicks();
 
     const uint32_t INACTIVITY_TIMEOUT = 5000; // ms: 5000 == 5 sec
+    int cursor_timer = scheduler_timer("cursor", INACTIVITY_TIMEOUT, false, hideCursor, &cursorVisible);
+
+    bool view_changed = !sendRenderCommand(DarkMode, ctrlA_pressed, font_size, window_width, (RenderCommand) {.type = RENDER_VIEW});
+    int caret_timer = scheduler_timer("caret", CARET_BLINK_MS, true, toggleCaret, &view_changed);
+    bool has_focus = SDL_GetWindowFlags(window) & SDL_WINDOW_INPUT_FOCUS;
+    blinkCaret(caret_timer, has_focus && SDL_IsTextInputActive(), &view_changed);
+
+    if (record_path) recorder_start(record_path);
+    if (replay_path && !replay_start(replay_path, replay_fast)) app_running = false;
+    Uint64 session_start = SDL_GetPerformanceCounter();
 
     while (app_running) {
-        if (cursorVisible && (SDL_GetTicks() - lastActivity) > INACTIVITY_TIMEOUT) {
-            cursorVisible = false;
-            SDL_ShowCursor(cursorVisible);
-        }
+        // Sleeps until there is input or a timer is due; a slow frame no longer delays sampling.
+        // A view that didn't fit in the ring is retried soon even without new input.
+        bool pending = SDL_WaitEventTimeout(&event, scheduler_wait_ms(view_changed ? 1 : INPUT_IDLE_WAIT));
+        Uint64 frame_start = SDL_GetPerformanceCounter();
 
         // Handle events
-        while (SDL_PollEvent(&event)) {
+        for (; pending; pending = SDL_PollEvent(&event)) {
+            recorder_write(&event);
             switch (event.type) {
                 case SDL_QUIT:
                     app_running = false;
@@ -160,6 +338,7 @@ int main(void) {
 
                 case SDL_TEXTINPUT:
                     add_user_input(event.text.text[0]);
+                    view_changed = true;
                     cursorVisible = false;
                     SDL_ShowCursor(cursorVisible);
                     break;
@@ -168,6 +347,13 @@ int main(void) {
                         if (event.window.
                                 event == SDL_WINDOWEVENT_SIZE_CHANGED) {
                                 SDL_GetWindowSize(window, &window_width, &window_height);
+                                view_changed = true;
+                        } else if (event.window.event == SDL_WINDOWEVENT_EXPOSED) {
+                                view_changed = true;
+                        } else if (event.window.event == SDL_WINDOWEVENT_FOCUS_GAINED ||
+                                   event.window.event == SDL_WINDOWEVENT_FOCUS_LOST) {
+                                has_focus = event.window.event == SDL_WINDOWEVENT_FOCUS_GAINED;
+                                blinkCaret(caret_timer, has_focus && SDL_IsTextInputActive(), &view_changed);
                         }
                         break;
 
@@ -179,48 +365,86 @@ int main(void) {
                                 if (ctrlA_pressed) {
                                         SDL_SetClipboardText(usr_inputs);
                                         ctrlA_pressed = false;
-                                        if (usr_inputs) {
-                                                free(usr_inputs);
-                                                usr_inputs = NULL;
-                                                usr_inputs_len = 0;
-                                                usr_inputs_capacity = 0;
-                                        }
+                                        clear_user_input();
+                                        view_changed = true;
                                 }
                                 break;
 
                             case SDLK_d:
-                                swap(&text_color, &background_color);
                                 DarkMode = !DarkMode;
-                                ReRenderAllPoints(renderer);
-                                SDL_RenderPresent(renderer);
+                                view_changed = true;
                                 break;
 
                             case SDLK_s:
-                                SaveAsImage(renderer);
-                                printf("Image Saved...\n");
+                                if (!(event.key.keysym.mod & KMOD_SHIFT)) {
+                                    // Read back from the next frame, reported through EXPORT_EVENT
+                                    sendRenderCommand(DarkMode, ctrlA_pressed, font_size, window_width, (RenderCommand) {.type = RENDER_SAVE_IMAGE});
+                                }
+                                // Written from a snapshot, drawing continues meanwhile
+                                runBoardTask("save", snapshotBoard(), saveDocumentTask, (BoardTask) {.full_save = event.key.keysym.mod & KMOD_SHIFT, .journal_position = journal_position()});
+                                break;
+
+                            case SDLK_f:
+                                // Text layout needs the font, which lives on the render thread
+                                sendRenderCommand(DarkMode, ctrlA_pressed, font_size, window_width, (RenderCommand) {.type = RENDER_EXPORT_CANVAS, .value = export_scale});
+                                break;
+
+                            case SDLK_g:
+                            case SDLK_p:
+                                sendRenderCommand(DarkMode, ctrlA_pressed, font_size, window_width,
+                                    (RenderCommand) {.type = RENDER_EXPORT_VECTOR, .value = event.key.keysym.sym == SDLK_p ? VECTOR_PDF : VECTOR_SVG});
+                                break;
+
+                            case SDLK_t:
+                                runBoardTask("csv export", snapshotBoard(), exportCSVTask, (BoardTask) {0});
+                                break;
+
+                            case SDLK_1:
+                            case SDLK_2:
+                            case SDLK_3:
+                            case SDLK_4:
+                                export_scale = 1 << (event.key.keysym.sym - SDLK_1);
+                                printf("Export scale: %dx\n", export_scale);
                                 break;
 
                             case SDLK_e:
                                 eraserMode = !eraserMode;
                                 break;
 
+                            case SDLK_l:
+                                low_latency = !low_latency;
+                                printf("Low latency inking: %s\n", low_latency ? "on" : "off");
+                                break;
+
+                            case SDLK_i:
+                                governor_print_stats();
+                                scheduler_print_stats();
+                                break;
+
+                            case SDLK_m:
+                                predict_motion = !predict_motion;
+                                printf("Motion prediction: %s\n", predict_motion ? "on" : "off");
+                                break;
+
                             case SDLK_a:
                                 ctrlA_pressed = !ctrlA_pressed;
+                                view_changed = true;
                                 break;
 
                             case SDLK_c:
                                 if (ctrlA_pressed) {
                                         SDL_SetClipboardText(usr_inputs);
                                         ctrlA_pressed = false;
+                                        view_changed = true;
                                 }
                                 break;
                             case SDLK_KP_PLUS:
                                 font_size += 1;
-                                font = TTF_OpenFont(FontLocation, font_size);
+                                view_changed = true;
                                 break;
                             case SDLK_KP_MINUS:
-                                font_size -= 1;
-                                font = TTF_OpenFont(FontLocation, font_size);
+                                if (font_size > 1) font_size -= 1;
+                                view_changed = true;
                                 break;
                         }
                     }
@@ -240,35 +464,26 @@ int main(void) {
 
                         case SDLK_RETURN:
                             add_user_input('\n');
+                            view_changed = true;
                             break;
 
                         case SDLK_BACKSPACE:
                                 if (ctrlA_pressed) {
                                         // Reset All
                                         if (points) {
-                                                pointCount = 0;
-                                                pointCapacity = 0;
-                                                free(points);
-                                                points = NULL;
-                                                // Clear board
-                                                SDL_SetRenderDrawColor(renderer, unpack_color(background_color));
-                                                SDL_RenderClear(renderer);
-                                                SDL_RenderPresent(renderer);
-                                        }
-                                        if (usr_inputs) {
-                                                free(usr_inputs);
-                                                usr_inputs = NULL;
-                                                usr_inputs_len = 0;
-                                                usr_inputs_capacity = 0;
+                                                clearPoints();
                                         }
+                                        clear_user_input();
                                         ctrlA_pressed = false;
                                 } else {
                                         pop_user_input();
                                 }
+                                view_changed = true;
                                 break;
 
                         case SDLK_TAB:
                             add_user_input('\t');
+                            view_changed = true;
                             break;
 
                         default:
@@ -284,7 +499,10 @@ int main(void) {
                         if (event.button.button == SDL_BUTTON_LEFT) {
                             isDrawing = true;
                             addPoint(event.button.x, event.button.y, line_thickness, isDrawing);
-                            cursor = SDL_CreateSystemCursor(SDL_SYSTEM_CURSOR_CROSSHAIR);
+                            view_changed = true;
+                            predictor_reset(&pointer_motion);
+                            predictor_add(&pointer_motion, event.button.x, event.button.y, event.button.timestamp);
+                            cursor = CROSSHAIR_CURSOR;
                             SDL_SetCursor(cursor);
                         }
                     }
@@ -297,6 +515,8 @@ int main(void) {
                         if (event.button.button == SDL_BUTTON_LEFT) {
                             isDrawing = false;
                             addPoint(event.button.x, event.button.y, line_thickness, isDrawing);
+                            view_changed = true;
+                            predictor_reset(&pointer_motion);
                             cursor = DEFAULT_CURSOR;
                             SDL_SetCursor(cursor);
                         }
@@ -304,7 +524,7 @@ int main(void) {
                     break;
 
                 case SDL_MOUSEMOTION:
-                    lastActivity = SDL_GetTicks();
+                    scheduler_restart(cursor_timer);
                     if (!cursorVisible) {
                         cursorVisible = true;
                         SDL_ShowCursor(cursorVisible);
@@ -313,45 +533,82 @@ int main(void) {
 
                     } else {
                         if (isDrawing) {
-                            addPoint(event.motion.x, event.motion.y, line_thickness, isDrawing); // Store the new point
-                            cursor = SDL_CreateSystemCursor(SDL_SYSTEM_CURSOR_CROSSHAIR);
-                            SDL_SetCursor(cursor);
+                            // This sample and every one queued right behind it go in as one batch
+                            motion[0] = event;
+                            size_t count = 1 + drainMotion(motion + 1, MOTION_BATCH - 1);
+                            for (size_t i = 0; i < count; i++) {
+                                samples[i] = (SDL_Point) {motion[i].motion.x, motion[i].motion.y};
+                                predictor_add(&pointer_motion, motion[i].motion.x, motion[i].motion.y, motion[i].motion.timestamp);
+                            }
+                            addPoints(samples, count, line_thickness, isDrawing); // Store the new points
+                            view_changed = true;
                         }
                     }
                     break;
+
+                default:
+                    if (event.type == JOB_EVENT) {
+                        jobs_dispatch(&event);
+                    } else if (event.type == EXPORT_EVENT) {
+                        if (event.user.code == 0) {
+                            printf("Image Saved: %s\n", (char*) event.user.data1);
+                        } else {
+                            printf("Image couldn't be saved\n");
+                        }
+                        free(event.user.data1);
+                    }
+                    break;
             }
         }
 
-        // Canvas Color i.e Background Color
-        SDL_SetRenderDrawColor(renderer, unpack_color(background_color));
-        SDL_RenderClear(renderer);
-
-        ReRenderAllPoints(renderer);
-        if (blinker_toggle_state()) {
-            // add_user_input('_');
-            RenderText(renderer, font, usr_inputs, window_width, ctrlA_pressed);
-            // pop_user_input();
-        } else {
-            RenderText(renderer, font, usr_inputs, window_width, ctrlA_pressed);
+        // Whatever changed what is drawn in this batch reaches the screen with the next frame
+        if (view_changed) {
+            view_changed = !sendRenderCommand(DarkMode, ctrlA_pressed, font_size, window_width, (RenderCommand) {.type = RENDER_VIEW});
         }
 
-        SDL_RenderPresent(renderer);
+        // Timers, then idle work in what is left of the frame
+        GovernorStats render_stats;
+        governor_stats(&render_stats);
+        scheduler_run(frame_start, (render_stats.frame_ms > 0 ? render_stats.frame_ms : 1000.0 / 60) * FRAME_BUDGET_SHARE);
+    }
+    recorder_stop();
+    if (replay_path) {
+        // Same numbers from every build for the same recording
+        replay_stop();
+        printf("Session took %.0f ms\n", (SDL_GetPerformanceCounter() - session_start) * 1000.0 / SDL_GetPerformanceFrequency());
+        governor_print_stats();
+        scheduler_print_stats();
     }
-    // Cleanup
-    SDL_FreeCursor(cursor);
 
-    free(points);
+    // Cleanup
+    SDL_SetCursor(NULL);
+    SDL_FreeCursor(DEFAULT_CURSOR);
+    SDL_FreeCursor(CROSSHAIR_CURSOR);
+    SDL_FreeCursor(WAIT_CURSOR);
+
+    // The final frame also goes into the warm start cache
+    sendRenderCommand(DarkMode, false, font_size, window_width, (RenderCommand) {.type = RENDER_QUIT});
+    SDL_WaitThread(render_thread, NULL);
+    SDL_DestroySemaphore(render.ready);
+
+    journal_shutdown(true); // Clean exit, nothing to recover next time
+    snapshot_shutdown(); // Background saves and exports read the mapping
+    clearPoints();
     free(usr_inputs);
+    document_close(&open_document);
+    document_shutdown(); // Waits for a running compaction
 
     SDL_StopTextInput(); // Disable text input
-    TTF_CloseFont(font);
 
-    SDL_DestroyRenderer(renderer);
+    export_shutdown(); // Finishes writing queued images
+    jobs_shutdown();
+
     SDL_DestroyWindow(window);
     IMG_Quit();
     SDL_Quit();
     return 0;
 }
+#endif
 
 // Set pixel with intensity blending
 void setPixel(SDL_Renderer* renderer, int x, int y, Uint8 r, Uint8 g, Uint8 b, Uint8 a, float intensity) {
@@ -435,137 +692,692 @@ void better_line(SDL_Renderer* renderer, int x1, int y1, int x2, int y2, int thi
 
 // Function to add a point to the array
 void addPoint(int x, int y, int line_thickness, bool connect) {
-    if (pointCount >= pointCapacity) {
+    SDL_Point sample = {x, y};
+    addPoints(&sample, 1, line_thickness, connect);
+}
+
+// Adds a run of samples: the array grows at most once per batch, and samples
+// closer than POINTS_THRESHOLD to the last kept point are dropped using integer
+// distances (no pow/sqrt per sample)
+void addPoints(const SDL_Point* samples, size_t count, int line_thickness, bool connect) {
+    if (pointCount + count > pointCapacity) {
         // Resize the array if needed
-        pointCapacity = pointCapacity == 0 ? 1 : pointCapacity * 2;
-        Point* temp = realloc(points, pointCapacity * sizeof(Point));
-        if (!temp) {
-            fprintf(stderr, "Memory allocation failed!\n");
-            free(points); // Free existing memory
-            exit(1);
-        }
-        points = temp;
+        while (pointCount + count > pointCapacity) pointCapacity = pointCapacity == 0 ? 1 : pointCapacity * 2;
+        // Moves out of the mapping, or away from snapshots that still read the old array
+        point_store = shared_grow(point_store, pointCount, pointCapacity, sizeof(Point));
+        points = point_store -> data;
     }
 
-    bool add_point;
+    const long long threshold = (long long) POINTS_THRESHOLD * POINTS_THRESHOLD;
+    bool filter = connect && pointCount > 0;
+    long long last_x = pointCount ? points[pointCount - 1].x : 0;
+    long long last_y = pointCount ? points[pointCount - 1].y : 0;
 
-    add_point = !connect ? true: pow(pow(points[pointCount - 1].x - x, 2) + pow(points[pointCount - 1].y - y, 2), 0.5) > POINTS_THRESHOLD ? true: false;
+    for (size_t i = 0; i < count; i++) {
+        long long dx = samples[i].x - last_x, dy = samples[i].y - last_y;
+        if (filter && dx * dx + dy * dy <= threshold) continue;
 
-    if (add_point){
-        points[pointCount].x = x;
-        points[pointCount].y = y;
+        points[pointCount].x = samples[i].x;
+        points[pointCount].y = samples[i].y;
         points[pointCount].connect = connect;
         points[pointCount].line_thickness = line_thickness;
         pointCount++;
+
+        if (connect) addToStroke(pointCount - 1);
+        journal_point(samples[i].x, samples[i].y, line_thickness, connect);
+
+        last_x = samples[i].x;
+        last_y = samples[i].y;
+        filter = connect;
     }
 }
 
-void RenderPoint(SDL_Renderer* renderer, Point p1, Point p2, SDL_Color color) {
-    if (p1.connect && p2.connect) {
-        SDL_SetRenderDrawColor(renderer, unpack_color(color));
-        better_line(renderer, p1.x, p1.y, p2.x, p2.y, (p1.line_thickness + p1.line_thickness) / 2);
-    }
+// Takes the motion events queued right behind the current one. Stops at the first
+// event of another type, so a button release is never handled before its motion.
+size_t drainMotion(SDL_Event* events, int max) {
+    int queued = SDL_PeepEvents(events, max, SDL_PEEKEVENT, SDL_FIRSTEVENT, SDL_LASTEVENT);
+    int run = 0;
+    while (run < queued && events[run].type == SDL_MOUSEMOTION) run++;
+    if (run == 0) return 0;
+
+    int taken = SDL_PeepEvents(events, run, SDL_GETEVENT, SDL_MOUSEMOTION, SDL_MOUSEMOTION);
+    for (int i = 0; i < taken; i++) recorder_write(&events[i]);
+    return taken > 0 ? (size_t) taken : 0;
 }
 
-// Function to redraw all stored points
-void ReRenderAllPoints(SDL_Renderer* renderer) {
-        if (pointCount != 0) {
-            for (size_t i = 0; i < pointCount - 1; i++) {
-                    RenderPoint(renderer, points[i], points[i + 1], text_color);
-            }
+// Extends the last stroke with points[index], or starts a new one after a lifted pen
+void addToStroke(size_t index) {
+    Stroke* last = strokeCount ? &strokes[strokeCount - 1] : NULL;
+    bool continues = last && index > 0 && points[index - 1].connect && last -> first + last -> count == index;
+
+    if (!continues) {
+        if (strokeCount >= strokeCapacity) {
+            strokeCapacity = strokeCapacity == 0 ? 16 : strokeCapacity * 2;
+            stroke_store = shared_grow(stroke_store, strokeCount, strokeCapacity, sizeof(Stroke));
+            strokes = stroke_store -> data;
         }
+        last = &strokes[strokeCount++];
+        *last = (Stroke) {index, 0, LLONG_MAX, LLONG_MAX, LLONG_MIN, LLONG_MIN};
+    }
+
+    const Point* p = &points[index];
+    long long reach = p -> line_thickness / 2 + 2; // Thickness slices plus the anti aliased neighbour
+    if (p -> x - reach < last -> min_x) last -> min_x = p -> x - reach;
+    if (p -> y - reach < last -> min_y) last -> min_y = p -> y - reach;
+    if (p -> x + reach > last -> max_x) last -> max_x = p -> x + reach;
+    if (p -> y + reach > last -> max_y) last -> max_y = p -> y + reach;
+    last -> count++;
 }
 
-int unique_name(char* folder, char* returnValue, size_t returnValueSize) {
-    if (!returnValue || returnValueSize == 0) return -1; // Error: Invalid buffer
+void clearPoints() {
+    journal_clear_points();
+    board_generation++;
+    // Snapshots keep their own references
+    shared_release(point_store);
+    shared_release(stroke_store);
+    points = NULL;
+    pointCount = 0;
+    pointCapacity = 0;
+    point_store = NULL;
+    strokes = NULL;
+    strokeCount = 0;
+    strokeCapacity = 0;
+    stroke_store = NULL;
+}
 
-    // Ensure folder Exists:
-    struct stat st = {0};
-    if (stat(folder, &st) == -1) {
-        mkdir(folder, 0700);
+// Stroke table for points that were loaded without one
+void rebuildStrokes() {
+    board_generation++;
+    shared_release(stroke_store);
+    strokes = NULL;
+    strokeCount = 0;
+    strokeCapacity = 0;
+    stroke_store = NULL;
+
+    for (size_t i = 0; i < pointCount; i++) {
+        if (points[i].connect) addToStroke(i);
     }
+}
 
-    // Get file count in the folder
-    char command[256];
-    snprintf(command, sizeof(command), "ls \"%s\" | wc -l", folder);
+// Takes over the arrays of an opened document. Mapped arrays stay in the mapping
+// until the first edit needs to grow them.
+void adoptDocument(ScratchDocument* doc) {
+    clearPoints();
+    points = doc -> points;
+    pointCount = pointCapacity = doc -> point_count;
+    point_store = shared_wrap(doc -> points, doc -> points_mapped);
+    strokes = doc -> strokes;
+    strokeCount = strokeCapacity = doc -> stroke_count;
+    stroke_store = shared_wrap(doc -> strokes, doc -> strokes_mapped);
 
-    FILE *fp = popen(command, "r");
-    if (!fp) {
-        printf("Failed to run command\n");
-        return 1;
+    free(usr_inputs);
+    usr_inputs = doc -> text;
+    usr_inputs_len = doc -> text_len;
+    usr_inputs_capacity = doc -> text_len + 1;
+
+    doc -> points = NULL;
+    doc -> strokes = NULL;
+    doc -> text = NULL;
+    doc -> points_mapped = doc -> strokes_mapped = false;
+}
+
+Snapshot* snapshotBoard() {
+    return snapshot_take(point_store, pointCount, stroke_store, strokeCount, usr_inputs, usr_inputs_len, board_generation);
+}
+
+// Takes over the reference to snapshot
+void runBoardTask(const char* name, Snapshot* snapshot, SnapshotTask task, BoardTask params) {
+    BoardTask* copy = malloc(sizeof(BoardTask));
+    if (!copy) {
+        fprintf(stderr, "Memory allocation failed!\n");
+        exit(1);
     }
+    *copy = params;
 
-    int count = 0;
-    if (fscanf(fp, "%d", &count) != 1) {
-        printf("Failed to read file count\n");
-        pclose(fp);
-        return 1;
+    snapshot_run(name, snapshot, task, copy);
+    snapshot_release(snapshot);
+}
+
+// The journal names boards by absolute path, so any spelling of the file finds its edits
+void boardBase(const char* path, char* base) {
+    char* resolved = realpath(path, NULL);
+    snprintf(base, JOURNAL_PATH_MAX + 1, "%s", resolved ? resolved : path);
+    free(resolved);
+}
+
+void saveDocumentTask(Snapshot* snapshot, void* data) {
+    BoardTask* params = data;
+    bool saved = false;
+    if (params -> full_save) {
+        saved = document_save(document_path, snapshot);
+        if (saved) {
+            printf("Drawing Saved: %s\n", document_path);
+        }
+    } else {
+        // Only the strokes since the last save are appended
+        int written = document_save_delta(document_path, snapshot);
+        saved = written >= 0;
+        if (saved) {
+            printf("Drawing Saved: %s (%d new points)\n", document_path, written);
+        }
     }
-    pclose(fp);
 
-    // Filepath
-    char* prefix = malloc(sizeof(char) * returnValueSize);
-    strcpy(prefix, returnValue);
+    // Edits up to the snapshot are in the file now, a crash only replays the rest onto it
+    if (saved) {
+        char base[JOURNAL_PATH_MAX + 1];
+        boardBase(document_path, base);
+        journal_checkpoint(params -> journal_position, base);
+    }
+}
+
+// The export continues in jobs of its own, which read the points until it calls back
+void exportCanvasTask(Snapshot* snapshot, void* data) {
+    BoardTask* params = data;
+    params -> canvas.points = snapshot -> points;
+    params -> canvas.point_count = snapshot -> point_count;
+    params -> canvas.finished = exportCanvasFinished;
+    params -> canvas.finished_data = snapshot_hold(snapshot);
+    ExportCanvas(&params -> canvas);
+}
+
+void exportCanvasFinished(void* data) {
+    snapshot_drop(data);
+}
+
+void exportVectorTask(Snapshot* snapshot, void* data) {
+    BoardTask* params = data;
+    params -> vector.points = snapshot -> points;
+    params -> vector.point_count = snapshot -> point_count;
+    params -> vector.text = snapshot -> text;
+    ExportVector(&params -> vector, params -> format);
+}
 
-    another_name:
-    snprintf(returnValue, returnValueSize, "%s%s%03d.png", folder, prefix, count);
-    snprintf(command, sizeof(command), "ls \"%s\" | grep \"%s\" | wc -l", folder, returnValue);
+void exportCSVTask(Snapshot* snapshot, void* data) {
+    (void) data;
+    ExportCSV(snapshot -> points, snapshot -> point_count);
+}
 
-    fp = popen(command, "r");
-    if (!fp) {
-        printf("Failed to run command\n");
+// Every command carries the view it was sent from. Only waits if the render
+// thread is RENDER_QUEUE_SIZE commands behind.
+// A view is only the latest state, so with the ring full it is dropped and sent again later;
+// saves, exports and quit happen once and wait for a slot
+bool sendRenderCommand(bool dark_mode, bool highlight, int font_size, int window_width, RenderCommand command) {
+    command.view = (RenderView) {snapshotBoard(), board_generation, dark_mode, highlight, caret_visible, font_size, window_width, low_latency, predict_motion, pointer_motion};
+    if (command.type == RENDER_VIEW) {
+        if (render_queue_push(&command)) return true;
+        snapshot_release(command.view.snapshot);
+        return false;
+    }
+    while (!render_queue_push(&command)) SDL_Delay(1);
+    return true;
+}
+
+// Owns the renderer and the font: draws the newest view every vsync, whatever the
+// event thread is busy with
+int RenderThread(void* data) {
+    RenderStart* start = data;
+
+    SDL_Renderer* renderer = SDL_CreateRenderer(start -> window, -1, SDL_RENDERER_ACCELERATED | SDL_RENDERER_PRESENTVSYNC);
+    if (renderer == NULL) {
+        // No GPU, or SDL_VIDEODRIVER=dummy for a headless replay
+        printf("No accelerated renderer (%s), drawing in software\n", SDL_GetError());
+        renderer = SDL_CreateRenderer(start -> window, -1, SDL_RENDERER_SOFTWARE);
+    }
+    if (renderer == NULL) {
+        printf("Renderer could not be created! SDL_Error: %s\n", SDL_GetError());
+        SDL_SemPost(start -> ready);
         return 1;
     }
-    if (fscanf(fp, "%d", &count) != 1) {
-        printf("Failed to read file count\n");
-        pclose(fp);
+    SDL_SetRenderDrawBlendMode(renderer, SDL_BLENDMODE_BLEND); // Blending mode enabled
+
+    text_color = (SDL_Color) {255, 255, 255, 255};
+    background_color = (SDL_Color) {0, 0, 0, 255};
+    SDL_SetRenderDrawColor(renderer, unpack_color(background_color)); // First look color
+    SDL_RenderClear(renderer);
+    if (start -> warm) RenderCachedCanvas(renderer, start -> warm);
+    SDL_RenderPresent(renderer);
+
+    int font_size = FONT_SIZE;
+    TTF_Font *font = TTF_OpenFont(FontLocation, font_size); // Load the font with the fixed size
+    if (!font) {
+        printf("Font loading failed: %s\n", TTF_GetError());
+        SDL_DestroyRenderer(renderer);
+        SDL_SemPost(start -> ready);
         return 1;
     }
-    print("%d", count);
-    if (count != 0) {
-        count++;
-        goto another_name;
+    start -> running = true;
+    SDL_SemPost(start -> ready);
+    governor_init(start -> window, renderer);
+
+    RenderView view = {0};
+    RetainedCanvas canvas = {0};
+    bool quit = false, refining = false;
+    Uint64 last_present = SDL_GetPerformanceCounter();
+    while (!quit) {
+        // Idle frames are only drawn for a command; while drawing the tip keeps moving,
+        // and a degraded redraw keeps refining
+        render_queue_wait(refining ? 0 : governor_wait_ms());
+
+        bool save_image = false, changed = false;
+        RenderCommand command;
+        while (render_queue_pop(&command)) {
+            changed = true;
+            snapshot_release(view.snapshot);
+            view = command.view;
+
+            text_color = view.dark_mode ? (SDL_Color) {255, 255, 255, 255} : (SDL_Color) {0, 0, 0, 255};
+            background_color = view.dark_mode ? (SDL_Color) {0, 0, 0, 255} : (SDL_Color) {255, 255, 255, 255};
+            if (view.font_size != font_size) {
+                TTF_Font* resized = TTF_OpenFont(FontLocation, view.font_size);
+                if (resized) {
+                    TTF_CloseFont(font);
+                    font = resized;
+                    font_size = view.font_size;
+                }
+            }
+
+            switch (command.type) {
+                case RENDER_VIEW:
+                    break;
+                case RENDER_SAVE_IMAGE:
+                    save_image = true;
+                    break;
+                case RENDER_EXPORT_CANVAS:
+                    ExportBoardCanvas(font, &view, command.value);
+                    break;
+                case RENDER_EXPORT_VECTOR:
+                    ExportBoardVector(font, &view, command.value);
+                    break;
+                case RENDER_QUIT:
+                    quit = true;
+                    break;
+            }
+        }
+        if (!view.snapshot) continue;
+
+        const Snapshot* board = view.snapshot;
+        bool drawing = board -> point_count > 0 && board -> points[board -> point_count - 1].connect;
+        governor_update(renderer, drawing);
+        if (!changed && !drawing && !refining) continue;
+
+        // Saved frames are never degraded
+        Uint64 frame_begin = SDL_GetPerformanceCounter();
+        refining = RenderBoard(renderer, &canvas, &view, save_image || quit);
+        // The caret is an underscore after the text, hidden while it is selected
+        RenderText(renderer, font, view.snapshot -> text, view.window_width, view.highlight, view.caret && !view.highlight);
+
+        if (save_image) SaveAsImage(renderer); // Reported back through EXPORT_EVENT
+        if (quit) {
+            if (start -> warm_path[0]) SaveWarmCache(renderer, start -> warm_path, view.snapshot); // Final board for the next launch's first frame
+            break;
+        }
+
+        if (view.low_latency) LateLatch(renderer, &view, last_present, governor_frame_ms());
+        if (view.predict) RenderPrediction(renderer, &view, governor_frame_ms());
+        SDL_RenderPresent(renderer);
+        governor_presented((SDL_GetPerformanceCounter() - frame_begin) * 1000.0 / SDL_GetPerformanceFrequency());
+        last_present = SDL_GetPerformanceCounter();
     }
 
-    pclose(fp);
-    free(prefix);
+    snapshot_release(view.snapshot);
+    if (canvas.texture) SDL_DestroyTexture(canvas.texture);
+    free(canvas.order);
+    TTF_CloseFont(font);
+    SDL_DestroyRenderer(renderer);
     return 0;
 }
 
-void SaveAsImage(SDL_Renderer* renderer) {
-    int win_width, win_height;
-    SDL_GetRendererOutputSize(renderer, &win_width, &win_height);
+// Draws the newest stroke segments just before present. The frame was rendered
+// early; this waits until LATCH_MARGIN_MS before the expected vblank, takes views
+// that arrived meanwhile and draws only their new segments, then adds a tip to
+// where the pointer is right now. The tip isn't a point, the next frame drops it.
+void LateLatch(SDL_Renderer* renderer, RenderView* view, Uint64 last_present, double frame_ms) {
+    const Snapshot* board = view -> snapshot;
+    if (board -> point_count == 0 || !board -> points[board -> point_count - 1].connect) return; // Not drawing
+
+    // Without vsync the frame goes out right away, there's no vblank to wait for
+    if (governor_vsync()) {
+        double elapsed = (double) (SDL_GetPerformanceCounter() - last_present) * 1000 / SDL_GetPerformanceFrequency();
+        double wait = frame_ms - LATCH_MARGIN_MS - elapsed;
+        if (wait >= 1) SDL_Delay((Uint32) wait);
+    }
 
-    // Create surface with current window dimensions
-    SDL_Surface *surface = SDL_CreateRGBSurface(0, win_width, win_height, 32, 0x00FF0000, 0x0000FF00, 0x000000FF, 0xFF000000);
-    if (!surface) {
-        printf("Unable to create surface: %s\n", SDL_GetError());
-        return;
+    // Newer boards that only add points; anything else waits for the next frame
+    size_t drawn = board -> point_count;
+    RenderCommand command;
+    while (render_queue_peek(&command) && command.type == RENDER_VIEW && command.view.dark_mode == view -> dark_mode &&
+           command.view.highlight == view -> highlight && command.view.caret == view -> caret && command.view.font_size == view -> font_size &&
+           command.view.window_width == view -> window_width && command.view.board == view -> board &&
+           command.view.snapshot -> point_count >= drawn &&
+           strcmp(command.view.snapshot -> text, board -> text) == 0) {
+        render_queue_pop(&command);
+        snapshot_release(view -> snapshot);
+        *view = command.view;
     }
+    board = view -> snapshot;
+    if (board -> point_count < drawn) return;
+
+    // Right before vblank there's no time for better_line, the next frame draws these exactly
+    RenderSegmentStrip(renderer, board -> points + drawn - 1, board -> point_count - drawn + 1, text_color);
+
+    const Point* last = &board -> points[board -> point_count - 1];
+    if (last -> connect) {
+        int x, y;
+        SDL_GetMouseState(&x, &y);
+        Point tip[2] = {*last, {x, y, last -> line_thickness, true}};
+        RenderSegmentStrip(renderer, tip, 2, text_color);
+    }
+}
 
-    // Check surface -> pixels before using it
-    if (!surface -> pixels) {
-        printf("Surface pixels are NULL after creation\n");
-        SDL_FreeSurface(surface);
-        surface = NULL;
-        return;
+// Provisional tail from the last point to where the pointer should be once this
+// frame is on screen. Drawn over the frame only; the next frame replaces it.
+void RenderPrediction(SDL_Renderer* renderer, const RenderView* view, double frame_ms) {
+    const Snapshot* board = view -> snapshot;
+    if (board -> point_count == 0 || !board -> points[board -> point_count - 1].connect) return; // Not drawing
+
+    int x, y;
+    if (!predictor_predict(&view -> motion, SDL_GetTicks() + (Uint32) (frame_ms * PREDICT_FRAMES), &x, &y)) return;
+
+    const Point* last = &board -> points[board -> point_count - 1];
+    Point predicted = {x, y, last -> line_thickness, true};
+    RenderPoint(renderer, *last, predicted, text_color);
+}
+
+// Whole board at RENDER_WINDOW size times scale, independent of the window.
+// Only the text layout happens here, TTF isn't thread safe.
+void ExportBoardCanvas(TTF_Font* font, const RenderView* view, int scale) {
+    TTF_Font* export_font = scale == 1 ? font : TTF_OpenFont(FontLocation, view -> font_size * scale);
+    SDL_Surface* text = export_font ? RenderTextSurface(export_font, view -> snapshot -> text, (view -> window_width - 2 * FONT_SIZE) * scale, text_color, background_color, false, false) : NULL;
+    CanvasExport job = {
+        .scale = scale,
+        .text = text,
+        .text_x = FONT_SIZE * scale,
+        .text_y = FONT_SIZE * scale,
+        .foreground = text_color,
+        .background = background_color,
+    };
+    runBoardTask("canvas export", snapshot_retain(view -> snapshot), exportCanvasTask, (BoardTask) {.canvas = job});
+    if (export_font && export_font != font) TTF_CloseFont(export_font);
+}
+
+void ExportBoardVector(TTF_Font* font, const RenderView* view, VectorFormat format) {
+    VectorExport job = {
+        .font_size = view -> font_size,
+        .line_height = TTF_FontLineSkip(font),
+        .text_x = FONT_SIZE,
+        .text_y = FONT_SIZE,
+        .foreground = text_color,
+        .background = background_color,
+    };
+    runBoardTask("vector export", snapshot_retain(view -> snapshot), exportVectorTask, (BoardTask) {.vector = job, .format = format});
+}
+
+void RenderPoint(SDL_Renderer* renderer, Point p1, Point p2, SDL_Color color) {
+    if (p1.connect && p2.connect) {
+        SDL_SetRenderDrawColor(renderer, unpack_color(color));
+        better_line(renderer, p1.x, p1.y, p2.x, p2.y, (p1.line_thickness + p1.line_thickness) / 2);
     }
+}
 
-    if (SDL_RenderReadPixels(renderer, NULL, surface -> format -> format, surface -> pixels, surface -> pitch) < 0) {
-        printf("Unable to read pixels: %s\n", SDL_GetError());
-        SDL_FreeSurface(surface);
-        return;
+static bool stroke_visible(const Stroke* stroke, int width, int height) {
+        return !(stroke -> max_x < 0 || stroke -> max_y < 0 || stroke -> min_x >= width || stroke -> min_y >= height);
+}
+
+// Draws strokes order[first, last) (or [first, last) without an order) and returns
+// the number of segments drawn. A cheap pass is one aliased polyline per stroke, a
+// small fraction of better_line's cost.
+size_t RenderStrokes(SDL_Renderer* renderer, const Snapshot* board, const size_t* order, size_t first, size_t last, int width, int height, bool cheap) {
+        size_t segments = 0;
+        SDL_Point line[256];
+        SDL_SetRenderDrawColor(renderer, unpack_color(text_color));
+        for (size_t k = first; k < last; k++) {
+                const Stroke* stroke = snapshot_stroke(board, order ? order[k] : k);
+                // Off screen strokes are skipped without reading (or paging in) their points
+                if (!stroke_visible(stroke, width, height) || stroke -> count < 2) continue;
+
+                size_t end = stroke -> first + stroke -> count;
+                if (cheap) {
+                        // Runs share their last point with the next one so the line stays joined
+                        for (size_t i = stroke -> first; i + 1 < end; ) {
+                                int n = 0;
+                                for (; i < end && n < (int) (sizeof(line) / sizeof(line[0])); i++, n++) {
+                                        line[n] = (SDL_Point) {board -> points[i].x, board -> points[i].y};
+                                }
+                                SDL_RenderDrawLines(renderer, line, n);
+                                if (i < end) i--;
+                        }
+                } else {
+                        for (size_t i = stroke -> first; i + 1 < end; i++) {
+                                RenderPoint(renderer, board -> points[i], board -> points[i + 1], text_color);
+                        }
+                }
+                segments += stroke -> count - 1;
+        }
+        return segments;
+}
+
+size_t CountSegments(const Snapshot* board, const size_t* order, size_t first, size_t last, int width, int height) {
+        size_t segments = 0;
+        for (size_t k = first; k < last; k++) {
+                const Stroke* stroke = snapshot_stroke(board, order ? order[k] : k);
+                if (stroke_visible(stroke, width, height) && stroke -> count > 1) segments += stroke -> count - 1;
+        }
+        return segments;
+}
+
+static void reserve_order(RetainedCanvas* canvas, size_t count) {
+        if (count <= canvas -> order_capacity) return;
+        size_t capacity = canvas -> order_capacity * 2 > count ? canvas -> order_capacity * 2 : count;
+        size_t* temp = realloc(canvas -> order, capacity * sizeof(size_t));
+        if (!temp) {
+                fprintf(stderr, "Memory allocation failed!\n");
+                exit(1);
+        }
+        canvas -> order = temp;
+        canvas -> order_capacity = capacity;
+}
+
+// Ring of PROGRESSIVE_RING px around the window centre that the stroke's box reaches into
+static size_t stroke_ring(const Stroke* stroke, long long cx, long long cy, size_t rings) {
+        long long dx = cx < stroke -> min_x ? stroke -> min_x - cx : cx > stroke -> max_x ? cx - stroke -> max_x : 0;
+        long long dy = cy < stroke -> min_y ? stroke -> min_y - cy : cy > stroke -> max_y ? cy - stroke -> max_y : 0;
+        size_t ring = (dx > dy ? dx : dy) / PROGRESSIVE_RING;
+        return ring < rings ? ring : rings - 1;
+}
+
+// Counting sort of the visible strokes [0, frozen) by ring, two linear passes
+void OrderStrokes(RetainedCanvas* canvas, const Snapshot* board, size_t frozen) {
+        long long cx = canvas -> width / 2, cy = canvas -> height / 2;
+        size_t rings = (canvas -> width > canvas -> height ? canvas -> width : canvas -> height) / 2 / PROGRESSIVE_RING + 1;
+        size_t* starts = calloc(rings + 1, sizeof(size_t));
+        if (!starts) {
+                fprintf(stderr, "Memory allocation failed!\n");
+                exit(1);
+        }
+
+        for (size_t s = 0; s < frozen; s++) {
+                const Stroke* stroke = snapshot_stroke(board, s);
+                if (stroke_visible(stroke, canvas -> width, canvas -> height)) starts[stroke_ring(stroke, cx, cy, rings) + 1]++;
+        }
+        for (size_t r = 0; r < rings; r++) starts[r + 1] += starts[r];
+
+        reserve_order(canvas, starts[rings]);
+        for (size_t s = 0; s < frozen; s++) {
+                const Stroke* stroke = snapshot_stroke(board, s);
+                if (stroke_visible(stroke, canvas -> width, canvas -> height)) canvas -> order[starts[stroke_ring(stroke, cx, cy, rings)]++] = s;
+        }
+        canvas -> ordered = starts[rings - 1];
+        canvas -> considered = frozen;
+        free(starts);
+}
+
+// The stroke being drawn as a triangle strip of its thickness
+void RenderStrokePreview(SDL_Renderer* renderer, const Snapshot* board, size_t s) {
+        const Stroke* stroke = snapshot_stroke(board, s);
+        RenderSegmentStrip(renderer, board -> points + stroke -> first, stroke -> count, text_color);
+}
+
+// Segments between connected points as quads of their thickness: one draw call per
+// PREVIEW_BATCH segments instead of better_line's pixel at a time coverage
+void RenderSegmentStrip(SDL_Renderer* renderer, const Point* line, size_t count, SDL_Color color) {
+        SDL_Vertex vertices[PREVIEW_BATCH * 4];
+        int indices[PREVIEW_BATCH * 6];
+        int quads = 0;
+
+        for (size_t i = 0; i + 1 < count; i++) {
+                Point a = line[i], b = line[i + 1];
+                if (!a.connect || !b.connect) continue;
+                float dx = b.x - a.x, dy = b.y - a.y;
+                float length = SDL_sqrtf(dx * dx + dy * dy);
+                if (length == 0) continue;
+
+                // Half thickness across the segment, and as much past its ends so joints overlap
+                float half = (a.line_thickness > 1 ? a.line_thickness : 1) / 2.0f;
+                float ux = dx / length * half, uy = dy / length * half;
+                SDL_FPoint corners[4] = {
+                        {a.x - ux - uy, a.y - uy + ux},
+                        {a.x - ux + uy, a.y - uy - ux},
+                        {b.x + ux - uy, b.y + uy + ux},
+                        {b.x + ux + uy, b.y + uy - ux},
+                };
+                for (int c = 0; c < 4; c++) {
+                        vertices[quads * 4 + c] = (SDL_Vertex) {corners[c], color, {0, 0}};
+                }
+                int base = quads * 4;
+                int quad[6] = {base, base + 1, base + 2, base + 1, base + 3, base + 2};
+                memcpy(indices + quads * 6, quad, sizeof(quad));
+
+                if (++quads == PREVIEW_BATCH) {
+                        SDL_RenderGeometry(renderer, NULL, vertices, quads * 4, indices, quads * 6);
+                        quads = 0;
+                }
+        }
+        if (quads) SDL_RenderGeometry(renderer, NULL, vertices, quads * 4, indices, quads * 6);
+}
+
+// Draws the board within RENDER_BUDGET_MS without ever blocking on a big redraw.
+// Finished strokes are refined into the retained canvas outward from the window
+// centre until the budget runs out. The rest is drawn exactly, or cheaply, if that
+// fits in what is left; otherwise the frame shows the canvas as far as it got.
+// Returns true while strokes are left to refine, so the caller keeps drawing
+// frames. exact ignores the budget.
+bool RenderBoard(SDL_Renderer* renderer, RetainedCanvas* canvas, const RenderView* view, bool exact) {
+        const Snapshot* board = view -> snapshot;
+        int width, height;
+        SDL_GetRendererOutputSize(renderer, &width, &height);
+
+        Uint64 start = SDL_GetPerformanceCounter();
+        double frequency = (double) SDL_GetPerformanceFrequency();
+        double budget_ms = governor_frame_ms() * FRAME_BUDGET_SHARE;
+        if (budget_ms > RENDER_BUDGET_MS) budget_ms = RENDER_BUDGET_MS;
+        if (canvas -> segment_cost <= 0) canvas -> segment_cost = SEGMENT_COST_NS;
+        if (canvas -> preview_cost <= 0) canvas -> preview_cost = PREVIEW_COST_NS;
+
+        if (!canvas -> texture || canvas -> width != width || canvas -> height != height) {
+                if (canvas -> texture) SDL_DestroyTexture(canvas -> texture);
+                canvas -> texture = NULL;
+                if (SDL_RenderTargetSupported(renderer)) {
+                        canvas -> texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_TARGET, width, height);
+                }
+                canvas -> width = width;
+                canvas -> height = height;
+                canvas -> board = view -> board + 1; // Forces a reset below
+        }
+
+        SDL_SetRenderDrawColor(renderer, unpack_color(background_color));
+        SDL_RenderClear(renderer);
+        if (!canvas -> texture) { // No render targets: every frame is a full redraw
+                RenderStrokes(renderer, board, NULL, 0, board -> stroke_count, width, height, false);
+                return false;
+        }
+
+        // A stroke is frozen once its button is released
+        bool drawing = board -> point_count > 0 && board -> points[board -> point_count - 1].connect;
+        size_t frozen = drawing && board -> stroke_count ? board -> stroke_count - 1 : board -> stroke_count;
+        if (canvas -> board != view -> board || canvas -> dark_mode != view -> dark_mode || canvas -> considered > frozen) {
+                SDL_SetRenderTarget(renderer, canvas -> texture);
+                SDL_SetRenderDrawColor(renderer, unpack_color(background_color));
+                SDL_RenderClear(renderer);
+                SDL_SetRenderTarget(renderer, NULL);
+                canvas -> board = view -> board;
+                canvas -> dark_mode = view -> dark_mode;
+                canvas -> refined = 0;
+                OrderStrokes(canvas, board, frozen);
+        }
+        // Strokes finished since are wherever the pen is, they go last
+        for (; canvas -> considered < frozen; canvas -> considered++) {
+                if (!stroke_visible(snapshot_stroke(board, canvas -> considered), width, height)) continue;
+                reserve_order(canvas, canvas -> ordered + 1);
+                canvas -> order[canvas -> ordered++] = canvas -> considered;
+        }
+
+        if (canvas -> refined < canvas -> ordered) {
+                SDL_SetRenderTarget(renderer, canvas -> texture);
+                size_t segments = 0;
+                while (canvas -> refined < canvas -> ordered && (exact || (SDL_GetPerformanceCounter() - start) * 1000.0 / frequency < budget_ms)) {
+                        segments += RenderStrokes(renderer, board, canvas -> order, canvas -> refined, canvas -> refined + 1, width, height, false);
+                        canvas -> refined++;
+                }
+                SDL_SetRenderTarget(renderer, NULL);
+
+                if (segments) {
+                        double spent_ns = (SDL_GetPerformanceCounter() - start) * 1e9 / frequency;
+                        canvas -> segment_cost = canvas -> segment_cost * 0.75 + spent_ns / segments * 0.25;
+                }
+        }
+        SDL_RenderCopy(renderer, canvas -> texture, NULL, NULL);
+
+        if (canvas -> refined < canvas -> ordered) {
+                Uint64 rest_start = SDL_GetPerformanceCounter();
+                double left_ms = budget_ms - (rest_start - start) * 1000.0 / frequency;
+                double rest = CountSegments(board, canvas -> order, canvas -> refined, canvas -> ordered, width, height);
+                if (rest * canvas -> segment_cost / 1e6 <= left_ms) {
+                        RenderStrokes(renderer, board, canvas -> order, canvas -> refined, canvas -> ordered, width, height, false);
+                } else if (rest * canvas -> preview_cost / 1e6 <= left_ms) {
+                        RenderStrokes(renderer, board, canvas -> order, canvas -> refined, canvas -> ordered, width, height, true);
+                        double spent_ns = (SDL_GetPerformanceCounter() - rest_start) * 1e9 / frequency;
+                        canvas -> preview_cost = canvas -> preview_cost * 0.75 + spent_ns / rest * 0.25;
+                }
+        }
+
+        // Until release the live stroke is only a preview; release commits it to the canvas
+        if (frozen < board -> stroke_count) {
+                if (exact) RenderStrokes(renderer, board, NULL, frozen, board -> stroke_count, width, height, false);
+                else RenderStrokePreview(renderer, board, frozen);
+        }
+        return canvas -> refined < canvas -> ordered;
+}
+
+// Pixels saved by the previous session, drawn at their original position
+void RenderCachedCanvas(SDL_Renderer* renderer, const ScratchDocument* doc) {
+    if (!doc -> canvas) return;
+
+    SDL_Surface* surface = SDL_CreateRGBSurfaceWithFormatFrom((void*) doc -> canvas, doc -> canvas_width, doc -> canvas_height, 32, doc -> canvas_width * 4, SDL_PIXELFORMAT_ARGB8888);
+    SDL_Texture* texture = surface ? SDL_CreateTextureFromSurface(renderer, surface) : NULL;
+    if (texture) {
+        SDL_Rect rect = {0, 0, doc -> canvas_width, doc -> canvas_height};
+        SDL_RenderCopy(renderer, texture, NULL, &rect);
+        SDL_DestroyTexture(texture);
     }
+    SDL_FreeSurface(surface);
+}
 
-    char filename[256] = "__image__"; // prefix of save file names
-    unique_name(FOLDER, filename, sizeof(filename));
+// Reads back what was last drawn (not yet presented) and stores it with the board
+bool SaveWarmCache(SDL_Renderer* renderer, const char* path, const Snapshot* board) {
+    int width, height;
+    SDL_GetRendererOutputSize(renderer, &width, &height);
 
-    // Save surface to PNG
-    if (IMG_SavePNG(surface, filename) != 0) {
-        printf("Unable to save frame as PNG: %s\n", IMG_GetError());
+    Uint32* pixels = malloc((size_t) width * height * sizeof(Uint32));
+    if (!pixels) {
+        fprintf(stderr, "Memory allocation failed!\n");
+        exit(1);
     }
+    bool saved = SDL_RenderReadPixels(renderer, NULL, SDL_PIXELFORMAT_ARGB8888, pixels, width * sizeof(Uint32)) == 0;
+    if (!saved) printf("Couldn't read the canvas: %s\n", SDL_GetError());
 
-    SDL_FreeSurface(surface);
+    saved = document_save_cache(path, board, saved ? pixels : NULL, width, height);
+    free(pixels);
+    return saved;
 }
 
 void add_user_input(char key_value) {
@@ -581,6 +1393,8 @@ void add_user_input(char key_value) {
         usr_inputs = temp;
     }
 
+    journal_text(key_value);
+
     // Append the character
     usr_inputs[usr_inputs_len] = key_value;
     usr_inputs_len++;
@@ -664,9 +1478,9 @@ char* append_string(char *s1, char *s2) {
     return result;
 }
 
-void RenderText(SDL_Renderer *renderer, TTF_Font *font, const char *text, int window_width, bool highlight) {
-    const int PADDING = FONT_SIZE; // Padding for positioning
-    int max_width_temp = window_width - 2 * PADDING;
+// Lays out the text the way it appears on the board, wrapped to max_width, with the
+// caret as an underscore at the end
+SDL_Surface* RenderTextSurface(TTF_Font *font, const char *text, int max_width_temp, SDL_Color txt_color, SDL_Color bg_color, bool highlight, bool caret) {
     Uint32 max_width = max_width_temp > 0 ? (Uint32)max_width_temp : 0;
 
     char *formattedTxt = replace(replace(text, "\t", "    "), " ", "  ");
@@ -676,15 +1490,24 @@ void RenderText(SDL_Renderer *renderer, TTF_Font *font, const char *text, int wi
 
     if (!formattedTxt) {
         print("Couldn't Render text");
-        return;
+        return NULL;
+    }
+    if (caret) {
+        // The formatted copy grows by one, usually in place
+        size_t len = strlen(formattedTxt);
+        char* grown = realloc(formattedTxt, len + 2);
+        if (grown) {
+            grown[len] = '_';
+            grown[len + 1] = '\0';
+            formattedTxt = grown;
+        }
     }
 
-    SDL_Color txt_color = text_color, bg_color = background_color;
     if (highlight) swap(&txt_color, &bg_color);
 
     SDL_Surface *textSurface = TTF_RenderText_Blended_Wrapped(font, formattedTxt, txt_color, max_width);
     free(formattedTxt);
-    if (!textSurface) return;
+    if (!textSurface) return NULL;
 
     if (highlight) {
             // Create background surface
@@ -692,7 +1515,7 @@ void RenderText(SDL_Renderer *renderer, TTF_Font *font, const char *text, int wi
                 0, textSurface -> w, textSurface -> h, 32, SDL_PIXELFORMAT_RGBA32);
             if (!bgSurface) {
                 SDL_FreeSurface(textSurface);
-                return;
+                return NULL;
             }
 
             // Fill with highlight color
@@ -711,6 +1534,15 @@ void RenderText(SDL_Renderer *renderer, TTF_Font *font, const char *text, int wi
             textSurface = bgSurface;
         }
 
+    return textSurface;
+}
+
+void RenderText(SDL_Renderer *renderer, TTF_Font *font, const char *text, int window_width, bool highlight, bool caret) {
+    const int PADDING = FONT_SIZE; // Padding for positioning
+
+    SDL_Surface *textSurface = RenderTextSurface(font, text, window_width - 2 * PADDING, text_color, background_color, highlight, caret);
+    if (!textSurface) return;
+
     SDL_Texture *textTexture = SDL_CreateTextureFromSurface(renderer, textSurface);
     if (!textTexture) return;
 
@@ -730,22 +1562,48 @@ void RenderText(SDL_Renderer *renderer, TTF_Font *font, const char *text, int wi
 }
 
 void pop_user_input() {
+        if (!usr_inputs) return;
+        journal_pop();
         if (usr_inputs_len != 0) {
                 usr_inputs_len -= 1;
         }
         usr_inputs[usr_inputs_len] = '\0';
 }
 
-bool blinker_toggle_state() {
-        static bool state = false;
-        static Uint32 last_toggle = 0;
-        Uint32 now = SDL_GetTicks(); // Get time in milliseconds
+void clear_user_input() {
+        if (usr_inputs) {
+                journal_clear_text();
+                free(usr_inputs);
+                usr_inputs = NULL;
+                usr_inputs_len = 0;
+                usr_inputs_capacity = 0;
+        }
+}
+
+// "caret" timer: the blink only shows with a new view, data is the loop's view_changed
+void toggleCaret(void* data) {
+        caret_visible = !caret_visible;
+        *(bool*) data = true;
+}
 
-        if (now - last_toggle >= 700) { // If 700 milli second has passed
-                state = !state;
-                last_toggle = now;
+// The caret only shows, and the timer only wakes the event thread, while typing would reach the board
+void blinkCaret(int caret_timer, bool typing, bool* view_changed) {
+        if (typing) {
+                if (!caret_visible) *view_changed = true;
+                caret_visible = true;
+                scheduler_restart(caret_timer);
+        } else {
+                if (caret_visible) *view_changed = true;
+                caret_visible = false;
+                scheduler_pause(caret_timer);
         }
-        return state;
+}
+
+// Inactivity timer: the cursor comes back with the next mouse motion
+void hideCursor(void* data) {
+        bool* cursorVisible = data;
+        *cursorVisible = false;
+        SDL_ShowCursor(*cursorVisible);
 }
 
 bool collisionDetection(int x1, int y1, int width1, int height1, int x2, int y2, int width2, int height2) {
@@ -0,0 +1,176 @@
+// Microbenchmark of the line kernels: better_line through SDL's software
+// renderer, next to raster_line, the kernel exports draw into memory with.
+//
+//   make microbench
+//
+// Sweeps line length, angle and thickness and prints JSON with ns and cycles
+// per pixel. Pixels are the nominal coverage, 2 per step along the major axis
+// per thickness slice, so every kernel is divided by the same count.
+
+#define SCRATCH_BENCH
+#include "main.c"
+#include "raster.h"
+
+#include <math.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#elif defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#endif
+
+#define CANVAS_SIZE (MICROBENCH_MAX_LENGTH * 2 + 64)
+
+typedef void (*LineKernel)(void* target, int x1, int y1, int x2, int y2, int thickness);
+
+// Cycle counter: rdtsc where there is one, perf_event_open on other Linux targets
+#if defined(__x86_64__) || defined(__i386__)
+static bool cycles_init(void) { return true; }
+static Uint64 cycles_now(void) { return __rdtsc(); }
+#elif defined(__linux__)
+static int cycles_fd = -1;
+static bool cycles_init(void) {
+    struct perf_event_attr attr = {0};
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.size = sizeof(attr);
+    attr.config = PERF_COUNT_HW_CPU_CYCLES;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    cycles_fd = syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+    return cycles_fd >= 0;
+}
+static Uint64 cycles_now(void) {
+    Uint64 count = 0;
+    if (read(cycles_fd, &count, sizeof(count)) != sizeof(count)) return 0;
+    return count;
+}
+#else
+static bool cycles_init(void) { return false; }
+static Uint64 cycles_now(void) { return 0; }
+#endif
+
+// The kernel the app uses, SDL calls per pixel
+static void kernel_better_line(void* target, int x1, int y1, int x2, int y2, int thickness) {
+    better_line(target, x1, y1, x2, y2, thickness);
+}
+
+// Just the per pixel SDL calls of better_line, along the same nominal pixels
+static void kernel_set_pixel(void* target, int x1, int y1, int x2, int y2, int thickness) {
+    int steps = abs(x2 - x1) > abs(y2 - y1) ? abs(x2 - x1) : abs(y2 - y1);
+    for (int t = -(thickness / 2); t <= thickness / 2; t++) {
+        for (int i = 0; i <= steps; i++) {
+            setPixel(target, x1 + i, y1 + t, unpack_color(text_color), 0.5f);
+            setPixel(target, x1 + i, y1 + t + 1, unpack_color(text_color), 0.5f);
+        }
+    }
+}
+
+// The export kernel, slice offsets worked out once per line
+static void kernel_raster_line(void* target, int x1, int y1, int x2, int y2, int thickness) {
+    raster_line(target, x1, y1, x2, y2, thickness, text_color);
+}
+
+// raster_line one slice at a time, with better_line's trig per slice
+static void kernel_raster_slice_trig(void* target, int x1, int y1, int x2, int y2, int thickness) {
+    bool steep = abs(y2 - y1) > abs(x2 - x1);
+    float gradient = steep ? (y2 == y1 ? 1.0f : (float) (x2 - x1) / (y2 - y1)) : (x2 == x1 ? 1.0f : (float) (y2 - y1) / (x2 - x1));
+    float perpendicular = gradient == 0 ? 1.0f : -1.0f / gradient;
+
+    for (int t = -(thickness / 2); t <= thickness / 2; t++) {
+        int major = t * cos(atan(perpendicular)), minor = t * sin(atan(perpendicular));
+        int ox = steep ? minor : major, oy = steep ? major : minor;
+        raster_line(target, x1 + ox, y1 + oy, x2 + ox, y2 + oy, 1, text_color);
+    }
+}
+
+// Aliased baseline: integer Bresenham per slice, one store per pixel
+static void kernel_bresenham(void* target, int x1, int y1, int x2, int y2, int thickness) {
+    RasterTarget* canvas = target;
+    int steep = abs(y2 - y1) > abs(x2 - x1);
+    for (int t = -(thickness / 2); t <= thickness / 2; t++) {
+        int x = x1 + (steep ? t : 0), y = y1 + (steep ? 0 : t);
+        int ex = x2 + (steep ? t : 0), ey = y2 + (steep ? 0 : t);
+        int dx = abs(ex - x), sx = x < ex ? 1 : -1;
+        int dy = -abs(ey - y), sy = y < ey ? 1 : -1;
+        int error = dx + dy;
+        while (true) {
+            if (x >= 0 && y >= 0 && x < CANVAS_SIZE && y < CANVAS_SIZE) canvas -> pixels[y * canvas -> pitch + x] = 0xFF000000;
+            if (x == ex && y == ey) break;
+            int e2 = 2 * error;
+            if (e2 >= dy) { error += dy; x += sx; }
+            if (e2 <= dx) { error += dx; y += sy; }
+        }
+    }
+}
+
+typedef struct {
+    const char* name;
+    LineKernel kernel;
+    bool renderer; // Draws through the SDL renderer rather than into the canvas
+} Kernel;
+
+static const Kernel kernels[] = {
+    {"better_line", kernel_better_line, true},
+    {"setPixel", kernel_set_pixel, true},
+    {"raster_line", kernel_raster_line, false},
+    {"raster_slice_trig", kernel_raster_slice_trig, false},
+    {"bresenham", kernel_bresenham, false},
+};
+
+int main(void) {
+    const int lengths[] = {8, 64, MICROBENCH_MAX_LENGTH};
+    const int angles[] = {0, 15, 45, 75, 90};
+    const int thicknesses[] = {1, 3, 9};
+
+    SDL_Surface* surface = SDL_CreateRGBSurfaceWithFormat(0, CANVAS_SIZE, CANVAS_SIZE, 32, SDL_PIXELFORMAT_ARGB8888);
+    SDL_Renderer* renderer = surface ? SDL_CreateSoftwareRenderer(surface) : NULL;
+    if (!renderer) {
+        printf("Software renderer could not be created! SDL_Error: %s\n", SDL_GetError());
+        return 1;
+    }
+    SDL_SetRenderDrawBlendMode(renderer, SDL_BLENDMODE_BLEND);
+    text_color = (SDL_Color) {0, 0, 0, 255};
+    RasterTarget canvas = {surface -> pixels, surface -> pitch / 4, 0, 0, CANVAS_SIZE, CANVAS_SIZE};
+    bool cycles = cycles_init();
+
+    double frequency = (double) SDL_GetPerformanceFrequency();
+    bool first = true;
+    printf("[\n");
+    for (size_t k = 0; k < SDL_arraysize(kernels); k++) {
+        for (size_t l = 0; l < SDL_arraysize(lengths); l++) {
+            for (size_t a = 0; a < SDL_arraysize(angles); a++) {
+                for (size_t t = 0; t < SDL_arraysize(thicknesses); t++) {
+                    double radians = angles[a] * M_PI / 180;
+                    int x1 = CANVAS_SIZE / 2, y1 = CANVAS_SIZE / 2;
+                    int x2 = x1 + (int) lround(lengths[l] * cos(radians)), y2 = y1 + (int) lround(lengths[l] * sin(radians));
+                    int major = abs(x2 - x1) > abs(y2 - y1) ? abs(x2 - x1) : abs(y2 - y1);
+                    int slices = thicknesses[t] / 2 * 2 + 1;
+                    void* target = kernels[k].renderer ? (void*) renderer : (void*) &canvas;
+
+                    // Repeats until the run is long enough for the timer
+                    Uint64 lines = 0, start = SDL_GetPerformanceCounter(), start_cycles = cycles ? cycles_now() : 0;
+                    double elapsed_ms = 0;
+                    while (elapsed_ms < MICROBENCH_MIN_MS) {
+                        for (int i = 0; i < 16; i++) kernels[k].kernel(target, x1, y1, x2, y2, thicknesses[t]);
+                        lines += 16;
+                        elapsed_ms = (SDL_GetPerformanceCounter() - start) * 1000.0 / frequency;
+                    }
+                    Uint64 spent_cycles = cycles ? cycles_now() - start_cycles : 0;
+
+                    double pixels = (double) lines * slices * 2 * (major + 1);
+                    printf("%s  {\"kernel\": \"%s\", \"length\": %d, \"angle\": %d, \"thickness\": %d, \"ns_per_pixel\": %.3f, \"cycles_per_pixel\": ",
+                        first ? "" : ",\n", kernels[k].name, lengths[l], angles[a], thicknesses[t], elapsed_ms * 1e6 / pixels);
+                    if (cycles) printf("%.2f}", spent_cycles / pixels);
+                    else printf("null}");
+                    first = false;
+                }
+            }
+        }
+    }
+    printf("\n]\n");
+
+    SDL_DestroyRenderer(renderer);
+    SDL_FreeSurface(surface);
+    return 0;
+}
@@ -0,0 +1,93 @@
+#include <SDL2/SDL.h>
+
+#include <math.h>
+#include <stdbool.h>
+
+#include "__macros.h"
+#include "predictor.h"
+
+void predictor_reset(Predictor* predictor) {
+    predictor -> count = 0;
+    predictor -> next = 0;
+}
+
+void predictor_add(Predictor* predictor, int x, int y, Uint32 time) {
+    predictor -> samples[predictor -> next].x = x;
+    predictor -> samples[predictor -> next].y = y;
+    predictor -> samples[predictor -> next].time = time;
+    predictor -> next = (predictor -> next + 1) % PREDICT_SAMPLES;
+    if (predictor -> count < PREDICT_SAMPLES) predictor -> count++;
+}
+
+// Solves the 3x3 normal equations by Cramer's rule, false when singular
+static bool solve3(const double m[3][3], const double r[3], double out[3]) {
+    double det = m[0][0] * (m[1][1] * m[2][2] - m[1][2] * m[2][1])
+               - m[0][1] * (m[1][0] * m[2][2] - m[1][2] * m[2][0])
+               + m[0][2] * (m[1][0] * m[2][1] - m[1][1] * m[2][0]);
+    if (fabs(det) < 1e-9) return false;
+
+    for (int c = 0; c < 3; c++) {
+        double a[3][3];
+        for (int i = 0; i < 3; i++) {
+            for (int j = 0; j < 3; j++) a[i][j] = j == c ? r[i] : m[i][j];
+        }
+        out[c] = (a[0][0] * (a[1][1] * a[2][2] - a[1][2] * a[2][1])
+                - a[0][1] * (a[1][0] * a[2][2] - a[1][2] * a[2][0])
+                + a[0][2] * (a[1][0] * a[2][1] - a[1][1] * a[2][0])) / det;
+    }
+    return true;
+}
+
+bool predictor_predict(const Predictor* predictor, Uint32 time, int* x, int* y) {
+    if (predictor -> count < 2) return false;
+
+    int newest = (predictor -> next + PREDICT_SAMPLES - 1) % PREDICT_SAMPLES;
+    Uint32 now = predictor -> samples[newest].time;
+    if ((Sint32) (time - now) < 0 || time - now > PREDICT_WINDOW_MS) return false;
+
+    // Time relative to the newest sample keeps the sums small and well conditioned
+    double m[3][3] = {{0}}, rx[3] = {0}, ry[3] = {0};
+    int used = 0;
+    for (int k = 0; k < predictor -> count; k++) {
+        int i = (newest + PREDICT_SAMPLES - k) % PREDICT_SAMPLES;
+        Uint32 age = now - predictor -> samples[i].time;
+        if (age > PREDICT_WINDOW_MS) break;
+
+        double t = -(double) age, powers[3] = {1, t, t * t};
+        for (int r = 0; r < 3; r++) {
+            for (int c = 0; c < 3; c++) m[r][c] += powers[r] * powers[c];
+            rx[r] += powers[r] * predictor -> samples[i].x;
+            ry[r] += powers[r] * predictor -> samples[i].y;
+        }
+        used++;
+    }
+    if (used < 2) return false;
+
+    double cx[3] = {0}, cy[3] = {0};
+    if (used < 3 || !solve3((const double (*)[3]) m, rx, cx) || !solve3((const double (*)[3]) m, ry, cy)) {
+        // Too few samples for a curve: constant velocity from the two newest
+        int previous = (newest + PREDICT_SAMPLES - 1) % PREDICT_SAMPLES;
+        double dt = (double) (now - predictor -> samples[previous].time);
+        if (dt <= 0) return false;
+        cx[0] = predictor -> samples[newest].x;
+        cy[0] = predictor -> samples[newest].y;
+        cx[1] = (predictor -> samples[newest].x - predictor -> samples[previous].x) / dt;
+        cy[1] = (predictor -> samples[newest].y - predictor -> samples[previous].y) / dt;
+        cx[2] = cy[2] = 0;
+    }
+
+    double t = (double) (time - now);
+    double px = cx[0] + cx[1] * t + cx[2] * t * t;
+    double py = cy[0] + cy[1] * t + cy[2] * t * t;
+
+    // An overshoot is worse than a short tip
+    double dx = px - predictor -> samples[newest].x, dy = py - predictor -> samples[newest].y;
+    double distance = sqrt(dx * dx + dy * dy);
+    if (distance > PREDICT_MAX_DISTANCE) {
+        px = predictor -> samples[newest].x + dx * PREDICT_MAX_DISTANCE / distance;
+        py = predictor -> samples[newest].y + dy * PREDICT_MAX_DISTANCE / distance;
+    }
+    *x = (int) lround(px);
+    *y = (int) lround(py);
+    return true;
+}
@@ -0,0 +1,28 @@
+#ifndef PREDICTOR_H
+#define PREDICTOR_H
+
+#include <SDL2/SDL.h>
+#include <stdbool.h>
+
+#include "__macros.h"
+
+// Extrapolates the pointer a frame or two ahead from its recent samples, so the
+// drawn tip can be where the pen will be when the frame is shown. Predictions
+// are only ever drawn, never added to the points.
+typedef struct {
+    struct {
+        int x, y;
+        Uint32 time; // ms, SDL event timestamp
+    } samples[PREDICT_SAMPLES];
+    int count, next;
+} Predictor;
+
+void predictor_reset(Predictor* predictor);
+void predictor_add(Predictor* predictor, int x, int y, Uint32 time);
+
+// Position at time (same clock as the samples). Least squares quadratic over the
+// samples of the last PREDICT_WINDOW_MS, limited to PREDICT_MAX_DISTANCE pixels
+// past the newest sample. False without enough recent samples.
+bool predictor_predict(const Predictor* predictor, Uint32 time, int* x, int* y);
+
+#endif
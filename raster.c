@@ -0,0 +1,149 @@
+#include <SDL2/SDL.h>
+
+#include <math.h>
+#include <stdbool.h>
+
+#include "__macros.h"
+#include "raster.h"
+
+void raster_clear(RasterTarget* target, SDL_Color color) {
+    Uint32 value = ((Uint32) color.a << 24) | ((Uint32) color.r << 16) | ((Uint32) color.g << 8) | color.b;
+    for (int row = 0; row < target -> h; row++) {
+        Uint32* line = target -> pixels + (size_t) row * target -> pitch;
+        for (int col = 0; col < target -> w; col++) {
+            line[col] = value;
+        }
+    }
+}
+
+// Same arithmetic as SDL_BLENDMODE_BLEND, so exports match the window
+void raster_blend(RasterTarget* target, int x, int y, SDL_Color color, float intensity) {
+    x -= target -> x;
+    y -= target -> y;
+    if (x < 0 || y < 0 || x >= target -> w || y >= target -> h) return;
+
+    float alpha = color.a * intensity;
+    if (alpha <= 0) return;
+    Uint32 a = alpha >= 255 ? 255 : (Uint32) alpha;
+
+    Uint32* pixel = target -> pixels + (size_t) y * target -> pitch + x;
+    Uint32 dst = *pixel;
+    Uint32 r = (color.r * a + ((dst >> 16) & 0xFF) * (255 - a)) / 255;
+    Uint32 g = (color.g * a + ((dst >> 8) & 0xFF) * (255 - a)) / 255;
+    Uint32 b = (color.b * a + (dst & 0xFF) * (255 - a)) / 255;
+    Uint32 dst_a = a + ((dst >> 24) * (255 - a)) / 255;
+    *pixel = (dst_a << 24) | (r << 16) | (g << 8) | b;
+}
+
+// Mirrors better_line slice for slice. The thickness offsets only depend on the
+// slope, so the trig is done once per line instead of once per slice. Each slice
+// only walks the part of its major axis that lies inside the target.
+void raster_line(RasterTarget* target, int x1, int y1, int x2, int y2, int thickness, SDL_Color color) {
+    int steep = abs(y2 - y1) > abs(x2 - x1);
+
+    if (steep) {
+        swap(&x1, &y1);
+        swap(&x2, &y2);
+    }
+
+    if (x1 > x2) {
+        swap(&x1, &x2);
+        swap(&y1, &y2);
+    }
+
+    float dx = (float)(x2 - x1);
+    float dy = (float)(y2 - y1);
+    float gradient = (dx == 0.0) ? 1.0 : dy / dx;
+    float perpendicular_gradient = (gradient == 0.0) ? 1.0 : -1.0 / gradient;
+    float step_x = cos(atan(perpendicular_gradient));
+    float step_y = sin(atan(perpendicular_gradient));
+
+    // The target along the major and minor axis
+    int major_first = steep ? target -> y : target -> x;
+    int major_end = major_first + (steep ? target -> h : target -> w);
+    int minor_first = steep ? target -> x : target -> y;
+    int minor_end = minor_first + (steep ? target -> w : target -> h);
+
+    for (int t = -(thickness / 2); t <= (thickness / 2); t++) {
+        float offset_x = t * step_x;
+        float offset_y = t * step_y;
+
+        int adjusted_x1 = x1 + offset_x;
+        int adjusted_y1 = y1 + offset_y;
+        int adjusted_x2 = x2 + offset_x;
+        int adjusted_y2 = y2 + offset_y;
+
+        float adjusted_dx = adjusted_x2 - adjusted_x1;
+        float adjusted_dy = adjusted_y2 - adjusted_y1;
+        float adjusted_gradient = (adjusted_dx == 0.0) ? 1.0 : adjusted_dy / adjusted_dx;
+        float intery = adjusted_y1 + adjusted_gradient * (adjusted_x1 - x1);
+
+        // Slices that miss the target entirely. intery starts up to a slice offset
+        // away from adjusted_y1, and the anti aliased neighbour is one more pixel.
+        int margin = thickness / 2 + 2;
+        int minor_low = (adjusted_y1 < adjusted_y2 ? adjusted_y1 : adjusted_y2) - margin;
+        int minor_high = (adjusted_y1 < adjusted_y2 ? adjusted_y2 : adjusted_y1) + margin;
+        if (minor_high < minor_first || minor_low >= minor_end) continue;
+        if (adjusted_x2 < major_first || adjusted_x1 >= major_end) continue;
+
+        int xpxl1 = adjusted_x1;
+        int ypxl1 = round(adjusted_y1);
+        float xgap = 1 - (adjusted_x1 + 0.5 - floor(adjusted_x1 + 0.5));
+        float frac = intery - floor(intery);
+
+        if (steep) {
+            raster_blend(target, ypxl1, xpxl1, color, (1 - frac) * xgap);
+            raster_blend(target, ypxl1 + 1, xpxl1, color, frac * xgap);
+        } else {
+            raster_blend(target, xpxl1, ypxl1, color, (1 - frac) * xgap);
+            raster_blend(target, xpxl1, ypxl1 + 1, color, frac * xgap);
+        }
+
+        // Measured from the slice start rather than accumulated, so the pixels
+        // don't depend on where the target clips the slice
+        int first = xpxl1 + 1 > major_first ? xpxl1 + 1 : major_first;
+        int end = adjusted_x2 < major_end ? adjusted_x2 : major_end;
+
+        for (int x = first; x < end; x++) {
+            float y_at = intery + adjusted_gradient * (x - xpxl1);
+            int y = floor(y_at);
+            float f = y_at - y;
+
+            if (steep) {
+                raster_blend(target, y, x, color, 1 - f);
+                raster_blend(target, y + 1, x, color, f);
+            } else {
+                raster_blend(target, x, y, color, 1 - f);
+                raster_blend(target, x, y + 1, color, f);
+            }
+        }
+    }
+}
+
+void raster_surface(RasterTarget* target, SDL_Surface* surface, int x, int y) {
+    if (!surface) return;
+
+    // Rows and columns of the surface that land inside the target
+    int first_row = target -> y - y > 0 ? target -> y - y : 0;
+    int last_row = target -> y + target -> h - y < surface -> h ? target -> y + target -> h - y : surface -> h;
+    int first_col = target -> x - x > 0 ? target -> x - x : 0;
+    int last_col = target -> x + target -> w - x < surface -> w ? target -> x + target -> w - x : surface -> w;
+    if (first_row >= last_row || first_col >= last_col) return;
+
+    SDL_Surface* argb = surface;
+    if (surface -> format -> format != SDL_PIXELFORMAT_ARGB8888) {
+        argb = SDL_ConvertSurfaceFormat(surface, SDL_PIXELFORMAT_ARGB8888, 0);
+        if (!argb) return;
+    }
+
+    for (int row = first_row; row < last_row; row++) {
+        const Uint32* line = (const Uint32*) ((const Uint8*) argb -> pixels + (size_t) row * argb -> pitch);
+        for (int col = first_col; col < last_col; col++) {
+            Uint32 src = line[col];
+            SDL_Color color = {(src >> 16) & 0xFF, (src >> 8) & 0xFF, src & 0xFF, 255};
+            raster_blend(target, x + col, y + row, color, (src >> 24) / 255.0f);
+        }
+    }
+
+    if (argb != surface) SDL_FreeSurface(argb);
+}
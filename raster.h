@@ -0,0 +1,24 @@
+#ifndef RASTER_H
+#define RASTER_H
+
+#include <SDL2/SDL.h>
+#include <stdbool.h>
+
+// A window into a larger canvas, backed by plain memory instead of a renderer.
+// pixels[0] is canvas pixel (x, y); everything outside w x h is clipped.
+typedef struct {
+    Uint32* pixels; // ARGB8888
+    int pitch;      // in pixels
+    int x, y, w, h;
+} RasterTarget;
+
+void raster_clear(RasterTarget* target, SDL_Color color);
+void raster_blend(RasterTarget* target, int x, int y, SDL_Color color, float intensity);
+
+// Same look as better_line, drawn into memory
+void raster_line(RasterTarget* target, int x1, int y1, int x2, int y2, int thickness, SDL_Color color);
+
+// Alpha blends a surface with its top left corner at canvas (x, y)
+void raster_surface(RasterTarget* target, SDL_Surface* surface, int x, int y);
+
+#endif
@@ -0,0 +1,276 @@
+#include <SDL2/SDL.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+
+#include "__macros.h"
+#include "recorder.h"
+
+// Every record starts with the ms since the first event (Uint32) and its kind
+typedef enum {
+    RECORD_QUIT = 1,
+    RECORD_KEY = 2,    // down, repeat (Uint8), scancode, sym (Sint32), mod (Uint16)
+    RECORD_TEXT = 3,   // length (Uint8), bytes
+    RECORD_MOTION = 4, // x, y, xrel, yrel (Sint32), state (Uint32)
+    RECORD_BUTTON = 5, // down, button, clicks (Uint8), x, y (Sint32)
+    RECORD_WHEEL = 6,  // x, y (Sint32)
+    RECORD_WINDOW = 7, // event (Uint8), data1, data2 (Sint32)
+} RecordKind;
+
+static const char magic[8] = "SCREVT1";
+
+static FILE* recording = NULL;
+static Uint32 first_timestamp = 0;
+static bool first_written = false;
+
+static SDL_Thread* replayer = NULL;
+static SDL_atomic_t replay_quit, replay_active;
+
+typedef struct {
+    Uint8* data;
+    size_t size;
+    bool fast;
+} Replay;
+
+static Replay replay;
+
+bool recorder_start(const char* path) {
+    recording = fopen(path, "wb");
+    if (!recording) {
+        printf("Couldn't record to %s: %s\n", path, strerror(errno));
+        return false;
+    }
+    setvbuf(recording, NULL, _IOFBF, RECORDER_BUFFER);
+    fwrite(magic, sizeof(magic), 1, recording);
+    first_written = false;
+    return true;
+}
+
+static Uint8* put(Uint8* p, const void* value, size_t size) {
+    memcpy(p, value, size);
+    return p + size;
+}
+
+void recorder_write(const SDL_Event* event) {
+    if (!recording) return;
+
+    Uint8 record[64];
+    Uint8* p = record + 5;
+    Uint8 kind;
+    switch (event -> type) {
+        case SDL_QUIT:
+            kind = RECORD_QUIT;
+            break;
+        case SDL_KEYDOWN:
+        case SDL_KEYUP: {
+            kind = RECORD_KEY;
+            Uint8 flags[2] = {event -> type == SDL_KEYDOWN, event -> key.repeat};
+            Sint32 scancode = event -> key.keysym.scancode, sym = event -> key.keysym.sym;
+            p = put(p, flags, 2);
+            p = put(p, &scancode, 4);
+            p = put(p, &sym, 4);
+            p = put(p, &event -> key.keysym.mod, 2);
+            break;
+        }
+        case SDL_TEXTINPUT: {
+            kind = RECORD_TEXT;
+            Uint8 length = strnlen(event -> text.text, sizeof(event -> text.text) - 1);
+            p = put(p, &length, 1);
+            p = put(p, event -> text.text, length);
+            break;
+        }
+        case SDL_MOUSEMOTION:
+            kind = RECORD_MOTION;
+            p = put(p, &event -> motion.x, 4);
+            p = put(p, &event -> motion.y, 4);
+            p = put(p, &event -> motion.xrel, 4);
+            p = put(p, &event -> motion.yrel, 4);
+            p = put(p, &event -> motion.state, 4);
+            break;
+        case SDL_MOUSEBUTTONDOWN:
+        case SDL_MOUSEBUTTONUP: {
+            kind = RECORD_BUTTON;
+            Uint8 flags[3] = {event -> type == SDL_MOUSEBUTTONDOWN, event -> button.button, event -> button.clicks};
+            p = put(p, flags, 3);
+            p = put(p, &event -> button.x, 4);
+            p = put(p, &event -> button.y, 4);
+            break;
+        }
+        case SDL_MOUSEWHEEL:
+            kind = RECORD_WHEEL;
+            p = put(p, &event -> wheel.x, 4);
+            p = put(p, &event -> wheel.y, 4);
+            break;
+        case SDL_WINDOWEVENT:
+            kind = RECORD_WINDOW;
+            p = put(p, &event -> window.event, 1);
+            p = put(p, &event -> window.data1, 4);
+            p = put(p, &event -> window.data2, 4);
+            break;
+        default:
+            return;
+    }
+
+    if (!first_written) {
+        first_timestamp = event -> common.timestamp;
+        first_written = true;
+    }
+    Uint32 time = event -> common.timestamp - first_timestamp;
+    memcpy(record, &time, 4);
+    record[4] = kind;
+    fwrite(record, p - record, 1, recording);
+}
+
+void recorder_stop(void) {
+    if (!recording) return;
+    if (fclose(recording) != 0) printf("Recording is incomplete: %s\n", strerror(errno));
+    recording = NULL;
+}
+
+// Returns the size of the record at data, or 0 when it is cut off or unknown
+static size_t decode(const Uint8* data, size_t left, Uint32* time, SDL_Event* event) {
+    static const size_t sizes[] = {0, 0, 12, 1, 20, 11, 8, 9};
+    if (left < 5 || data[4] < RECORD_QUIT || data[4] > RECORD_WINDOW) return 0;
+    size_t size = 5 + sizes[data[4]];
+    if (data[4] == RECORD_TEXT && left > 5) size += data[5];
+    if (left < size) return 0;
+
+    memcpy(time, data, 4);
+    const Uint8* p = data + 5;
+    memset(event, 0, sizeof(*event));
+    switch ((RecordKind) data[4]) {
+        case RECORD_QUIT:
+            event -> type = SDL_QUIT;
+            break;
+        case RECORD_KEY: {
+            Sint32 scancode, sym;
+            event -> type = p[0] ? SDL_KEYDOWN : SDL_KEYUP;
+            event -> key.state = p[0] ? SDL_PRESSED : SDL_RELEASED;
+            event -> key.repeat = p[1];
+            memcpy(&scancode, p + 2, 4);
+            memcpy(&sym, p + 6, 4);
+            memcpy(&event -> key.keysym.mod, p + 10, 2);
+            event -> key.keysym.scancode = scancode;
+            event -> key.keysym.sym = sym;
+            break;
+        }
+        case RECORD_TEXT:
+            event -> type = SDL_TEXTINPUT;
+            memcpy(event -> text.text, p + 1, p[0] < sizeof(event -> text.text) ? p[0] : sizeof(event -> text.text) - 1);
+            break;
+        case RECORD_MOTION:
+            event -> type = SDL_MOUSEMOTION;
+            memcpy(&event -> motion.x, p, 4);
+            memcpy(&event -> motion.y, p + 4, 4);
+            memcpy(&event -> motion.xrel, p + 8, 4);
+            memcpy(&event -> motion.yrel, p + 12, 4);
+            memcpy(&event -> motion.state, p + 16, 4);
+            break;
+        case RECORD_BUTTON:
+            event -> type = p[0] ? SDL_MOUSEBUTTONDOWN : SDL_MOUSEBUTTONUP;
+            event -> button.state = p[0] ? SDL_PRESSED : SDL_RELEASED;
+            event -> button.button = p[1];
+            event -> button.clicks = p[2];
+            memcpy(&event -> button.x, p + 3, 4);
+            memcpy(&event -> button.y, p + 7, 4);
+            break;
+        case RECORD_WHEEL:
+            event -> type = SDL_MOUSEWHEEL;
+            memcpy(&event -> wheel.x, p, 4);
+            memcpy(&event -> wheel.y, p + 4, 4);
+            break;
+        case RECORD_WINDOW:
+            event -> type = SDL_WINDOWEVENT;
+            event -> window.event = p[0];
+            memcpy(&event -> window.data1, p + 1, 4);
+            memcpy(&event -> window.data2, p + 5, 4);
+            break;
+    }
+    return size;
+}
+
+static int replay_loop(void* data) {
+    (void) data;
+    Uint32 start = SDL_GetTicks();
+    size_t offset = sizeof(magic), events = 0;
+
+    while (!SDL_AtomicGet(&replay_quit)) {
+        Uint32 time;
+        SDL_Event event;
+        size_t size = decode(replay.data + offset, replay.size - offset, &time, &event);
+        if (size == 0) break;
+        offset += size;
+
+        if (replay.fast) {
+            // Only as far ahead as the event loop keeps up
+            while (SDL_PeepEvents(NULL, 0, SDL_PEEKEVENT, SDL_FIRSTEVENT, SDL_LASTEVENT) > REPLAY_BACKLOG && !SDL_AtomicGet(&replay_quit)) {
+                SDL_Delay(1);
+            }
+        } else {
+            Sint32 wait = (Sint32) (start + time - SDL_GetTicks());
+            if (wait > 0) SDL_Delay(wait);
+        }
+        if (event.type == SDL_QUIT) break; // Pushed below either way
+        if (SDL_PushEvent(&event) < 0) SDL_Delay(1);
+        events++;
+    }
+
+    if (offset < replay.size && !SDL_AtomicGet(&replay_quit)) printf("Replay stopped at a damaged record\n");
+    printf("Replayed %zu events in %u ms\n", events, SDL_GetTicks() - start);
+
+    SDL_Event quit = {.type = SDL_QUIT};
+    SDL_PushEvent(&quit);
+    SDL_AtomicSet(&replay_active, 0);
+    return 0;
+}
+
+bool replay_start(const char* path, bool fast) {
+    FILE* file = fopen(path, "rb");
+    if (!file) {
+        printf("Couldn't open %s: %s\n", path, strerror(errno));
+        return false;
+    }
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+
+    replay.data = size > 0 ? malloc(size) : NULL;
+    bool loaded = replay.data && fread(replay.data, size, 1, file) == 1;
+    fclose(file);
+    if (!loaded || (size_t) size < sizeof(magic) || memcmp(replay.data, magic, sizeof(magic)) != 0) {
+        printf("%s is not an input recording\n", path);
+        free(replay.data);
+        replay.data = NULL;
+        return false;
+    }
+    replay.size = size;
+    replay.fast = fast;
+
+    SDL_AtomicSet(&replay_quit, 0);
+    SDL_AtomicSet(&replay_active, 1);
+    replayer = SDL_CreateThread(replay_loop, "replay", NULL);
+    if (!replayer) {
+        printf("Couldn't start replay: %s\n", SDL_GetError());
+        SDL_AtomicSet(&replay_active, 0);
+        free(replay.data);
+        replay.data = NULL;
+        return false;
+    }
+    return true;
+}
+
+bool replay_running(void) {
+    return SDL_AtomicGet(&replay_active) != 0;
+}
+
+void replay_stop(void) {
+    if (!replayer) return;
+    SDL_AtomicSet(&replay_quit, 1);
+    SDL_WaitThread(replayer, NULL);
+    replayer = NULL;
+    free(replay.data);
+    replay.data = NULL;
+}
@@ -0,0 +1,23 @@
+#ifndef RECORDER_H
+#define RECORDER_H
+
+#include <SDL2/SDL.h>
+#include <stdbool.h>
+
+// Input recorder for performance regression runs. A recording holds the input
+// events of a session with their timestamps, in a compact binary format. A
+// replay pushes them back into SDL's queue from its own thread, so they take
+// the same path through the event loop as live input.
+
+bool recorder_start(const char* path);
+// Input events only; events the app posts to itself are left out
+void recorder_write(const SDL_Event* event);
+void recorder_stop(void);
+
+// fast: no waiting between events, only for the event loop to keep up.
+// An SDL_QUIT follows the last event, so a replay always ends the session.
+bool replay_start(const char* path, bool fast);
+bool replay_running(void);
+void replay_stop(void);
+
+#endif
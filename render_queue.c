@@ -0,0 +1,64 @@
+#include <SDL2/SDL.h>
+
+#include <stdbool.h>
+
+#include "__macros.h"
+#include "render_queue.h"
+
+// Power of two, so the indices can run freely and wrap with a mask
+static RenderCommand ring[RENDER_QUEUE_SIZE];
+static SDL_atomic_t head; // Next slot to read, written by the render thread
+static SDL_atomic_t tail; // Next slot to write, written by the event thread
+
+// The producer only posts when the consumer announced it is about to sleep
+static SDL_sem* wake = NULL;
+static SDL_atomic_t sleeping;
+
+bool render_queue_push(const RenderCommand* command) {
+    unsigned write = SDL_AtomicGet(&tail);
+    if (write - (unsigned) SDL_AtomicGet(&head) == RENDER_QUEUE_SIZE) return false;
+
+    ring[write & (RENDER_QUEUE_SIZE - 1)] = *command;
+    SDL_MemoryBarrierRelease(); // The slot is filled before the consumer can see it
+    SDL_AtomicSet(&tail, write + 1);
+
+    if (SDL_AtomicCAS(&sleeping, 1, 0)) SDL_SemPost(wake);
+    return true;
+}
+
+void render_queue_wait(Uint32 timeout) {
+    if (!wake) wake = SDL_CreateSemaphore(0); // Before the first wait, the producer can't post yet
+    if (!wake) {
+        SDL_Delay(1);
+        return;
+    }
+
+    SDL_AtomicSet(&sleeping, 1);
+    // A command pushed before the flag was visible would otherwise be missed
+    bool woken = false;
+    if (SDL_AtomicGet(&head) == SDL_AtomicGet(&tail)) woken = SDL_SemWaitTimeout(wake, timeout) == 0;
+    if (!SDL_AtomicCAS(&sleeping, 1, 0) && !woken) {
+        // The producer cleared the flag and posted (or is about to), take that post
+        SDL_SemWait(wake);
+    }
+}
+
+bool render_queue_peek(RenderCommand* command) {
+    unsigned read = SDL_AtomicGet(&head);
+    if (read == (unsigned) SDL_AtomicGet(&tail)) return false;
+    SDL_MemoryBarrierAcquire();
+
+    *command = ring[read & (RENDER_QUEUE_SIZE - 1)];
+    return true;
+}
+
+bool render_queue_pop(RenderCommand* command) {
+    unsigned read = SDL_AtomicGet(&head);
+    if (read == (unsigned) SDL_AtomicGet(&tail)) return false;
+    SDL_MemoryBarrierAcquire();
+
+    *command = ring[read & (RENDER_QUEUE_SIZE - 1)];
+    SDL_MemoryBarrierRelease(); // The slot is copied out before the producer can reuse it
+    SDL_AtomicSet(&head, read + 1);
+    return true;
+}
@@ -0,0 +1,48 @@
+#ifndef RENDER_QUEUE_H
+#define RENDER_QUEUE_H
+
+#include <SDL2/SDL.h>
+#include <stdbool.h>
+
+#include "snapshot.h"
+#include "predictor.h"
+
+// Commands from the event thread to the render thread. One producer, one
+// consumer and no locks: each side only ever writes its own index.
+
+typedef enum {
+    RENDER_VIEW,          // New board and view state
+    RENDER_SAVE_IMAGE,    // SaveAsImage of the next frame
+    RENDER_EXPORT_CANVAS, // value: export scale
+    RENDER_EXPORT_VECTOR, // value: VectorFormat
+    RENDER_QUIT,          // Render the final frame into the warm start cache and stop
+} RenderCommandType;
+
+// Everything a frame is drawn from
+typedef struct {
+    Snapshot* snapshot;
+    Uint32 board; // Changes whenever strokes are removed rather than appended
+    bool dark_mode, highlight;
+    bool caret; // Blink phase of the text caret
+    int font_size, window_width;
+    bool low_latency; // Late latch the stroke tip before present
+    bool predict;     // Draw a predicted tail from motion
+    Predictor motion;
+} RenderView;
+
+typedef struct {
+    RenderCommandType type;
+    RenderView view; // RENDER_VIEW; the snapshot reference moves with the command
+    int value;
+} RenderCommand;
+
+// Returns false when the ring is full
+bool render_queue_push(const RenderCommand* command);
+// Returns false when the ring is empty
+bool render_queue_pop(RenderCommand* command);
+// Copies the next command without taking it; consumer side only
+bool render_queue_peek(RenderCommand* command);
+// Consumer side: sleeps until a command is queued or timeout ms have passed
+void render_queue_wait(Uint32 timeout);
+
+#endif
@@ -0,0 +1,148 @@
+#include <SDL2/SDL.h>
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "__macros.h"
+#include "scheduler.h"
+
+typedef struct {
+    const char* name;
+    bool timer; // false: idle task
+    Uint64 runs;
+    double total_ms, max_ms;
+} SchedulerTaskStats;
+
+typedef struct {
+    bool used, armed;
+    SchedulerTaskStats stats;
+    // Timers
+    Uint32 interval, due;
+    bool repeat;
+    SchedulerTimer timer;
+    // Idle tasks
+    SchedulerIdle idle;
+    void* data;
+} Task;
+
+static Task tasks[SCHEDULER_TASKS];
+static int next_idle = 0; // Round robin start, so one long task can't starve the rest
+
+static int add_task(const char* name) {
+    for (int i = 0; i < SCHEDULER_TASKS; i++) {
+        if (tasks[i].used) continue;
+        memset(&tasks[i], 0, sizeof(Task));
+        tasks[i].used = tasks[i].armed = true;
+        tasks[i].stats.name = name;
+        return i;
+    }
+    printf("Scheduler is full, %s not added\n", name);
+    return -1;
+}
+
+int scheduler_timer(const char* name, Uint32 interval_ms, bool repeat, SchedulerTimer fn, void* data) {
+    int id = add_task(name);
+    if (id < 0) return id;
+    tasks[id].stats.timer = true;
+    tasks[id].interval = interval_ms;
+    tasks[id].due = SDL_GetTicks() + interval_ms;
+    tasks[id].repeat = repeat;
+    tasks[id].timer = fn;
+    tasks[id].data = data;
+    return id;
+}
+
+int scheduler_idle(const char* name, SchedulerIdle fn, void* data) {
+    int id = add_task(name);
+    if (id < 0) return id;
+    tasks[id].idle = fn;
+    tasks[id].data = data;
+    return id;
+}
+
+void scheduler_restart(int id) {
+    if (id < 0 || !tasks[id].used) return;
+    tasks[id].armed = true;
+    tasks[id].due = SDL_GetTicks() + tasks[id].interval;
+}
+
+void scheduler_pause(int id) {
+    if (id >= 0) tasks[id].armed = false;
+}
+
+void scheduler_cancel(int id) {
+    if (id >= 0) tasks[id].used = false;
+}
+
+static double elapsed_ms(Uint64 since) {
+    return (SDL_GetPerformanceCounter() - since) * 1000.0 / SDL_GetPerformanceFrequency();
+}
+
+static void account(Task* task, Uint64 start) {
+    double ms = elapsed_ms(start);
+    task -> stats.runs++;
+    task -> stats.total_ms += ms;
+    if (ms > task -> stats.max_ms) task -> stats.max_ms = ms;
+}
+
+void scheduler_run(Uint64 frame_start, double budget_ms) {
+    Uint32 now = SDL_GetTicks();
+    for (int i = 0; i < SCHEDULER_TASKS; i++) {
+        Task* task = &tasks[i];
+        // Wrap safe: due is at most an interval ahead
+        if (!task -> used || !task -> timer || !task -> armed || (Sint32) (now - task -> due) < 0) continue;
+
+        if (task -> repeat) {
+            task -> due = now + task -> interval;
+        } else {
+            task -> armed = false;
+        }
+        Uint64 start = SDL_GetPerformanceCounter();
+        task -> timer(task -> data);
+        account(task, start);
+    }
+
+    // Idle slices only in what the frame has left; each task at most once per pass
+    for (bool progress = true; progress && elapsed_ms(frame_start) < budget_ms; ) {
+        progress = false;
+        for (int n = 0; n < SCHEDULER_TASKS && elapsed_ms(frame_start) < budget_ms; n++) {
+            int i = (next_idle + n) % SCHEDULER_TASKS;
+            Task* task = &tasks[i];
+            if (!task -> used || !task -> idle) continue;
+
+            Uint64 start = SDL_GetPerformanceCounter();
+            bool more = task -> idle(task -> data);
+            account(task, start);
+            if (!more) task -> used = false;
+            progress = true;
+            next_idle = (i + 1) % SCHEDULER_TASKS;
+        }
+    }
+}
+
+Uint32 scheduler_wait_ms(Uint32 max_ms) {
+    Uint32 now = SDL_GetTicks();
+    Uint32 wait = max_ms;
+    for (int i = 0; i < SCHEDULER_TASKS; i++) {
+        const Task* task = &tasks[i];
+        if (!task -> used) continue;
+        if (task -> idle) return 0;
+        if (!task -> armed) continue;
+
+        Sint32 left = (Sint32) (task -> due - now);
+        if (left <= 0) return 0;
+        if ((Uint32) left < wait) wait = left;
+    }
+    return wait;
+}
+
+void scheduler_print_stats(void) {
+    printf("Scheduler:\n");
+    for (int i = 0; i < SCHEDULER_TASKS; i++) {
+        const SchedulerTaskStats* stats = &tasks[i].stats;
+        if (!stats -> name) continue;
+        printf("  %-12s %-5s %8llu runs, %9.2f ms total, %6.3f ms max%s\n", stats -> name, stats -> timer ? "timer" : "idle",
+            (unsigned long long) stats -> runs, stats -> total_ms, stats -> max_ms, tasks[i].used ? "" : " (done)");
+    }
+}
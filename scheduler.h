@@ -0,0 +1,38 @@
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include <SDL2/SDL.h>
+#include <stdbool.h>
+
+#include "__macros.h"
+
+// Cooperative scheduler for the event thread. Timers fire once they're due;
+// idle tasks get slices of whatever is left of the frame budget after input,
+// round robin, until they report they are done. Nothing here preempts: a
+// slice should only do a bounded bit of work.
+
+typedef void (*SchedulerTimer)(void* data);
+// Does one slice, returns true while there is more to do
+typedef bool (*SchedulerIdle)(void* data);
+
+// Both return an id for the calls below, or -1 once SCHEDULER_TASKS are in use
+int scheduler_timer(const char* name, Uint32 interval_ms, bool repeat, SchedulerTimer fn, void* data);
+int scheduler_idle(const char* name, SchedulerIdle fn, void* data);
+
+// Starts a timer's interval over, e.g. on activity; re-arms a one shot that already fired
+void scheduler_restart(int id);
+// The timer doesn't fire, nor keeps the event thread awake, until scheduler_restart
+void scheduler_pause(int id);
+void scheduler_cancel(int id);
+
+// Runs due timers, then idle slices until budget_ms have passed since frame_start
+// (an SDL_GetPerformanceCounter value)
+void scheduler_run(Uint64 frame_start, double budget_ms);
+
+// How long the event thread may sleep before the scheduler needs it, at most max_ms
+Uint32 scheduler_wait_ms(Uint32 max_ms);
+
+// Runs and time used per task
+void scheduler_print_stats(void);
+
+#endif
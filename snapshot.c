@@ -0,0 +1,169 @@
+#include <SDL2/SDL.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "__macros.h"
+#include "snapshot.h"
+#include "jobs.h"
+
+static SDL_atomic_t next_version;
+
+static SDL_mutex* task_lock = NULL;
+static SDL_cond* task_done = NULL;
+static int tasks_running = 0;
+
+SharedArray* shared_wrap(void* data, bool mapped) {
+    SharedArray* array = malloc(sizeof(SharedArray));
+    if (!array) {
+        fprintf(stderr, "Memory allocation failed!\n");
+        exit(1);
+    }
+    SDL_AtomicSet(&array -> refs, 1);
+    array -> data = data;
+    array -> mapped = mapped;
+    return array;
+}
+
+SharedArray* shared_grow(SharedArray* array, size_t count, size_t capacity, size_t size) {
+    if (array && !array -> mapped && SDL_AtomicGet(&array -> refs) == 1) {
+        void* temp = realloc(array -> data, capacity * size);
+        if (!temp) {
+            fprintf(stderr, "Memory allocation failed!\n");
+            exit(1);
+        }
+        array -> data = temp;
+        return array;
+    }
+
+    // A snapshot (or the mapping) still reads the old storage: copy out and let go
+    void* data = malloc(capacity * size);
+    if (!data) {
+        fprintf(stderr, "Memory allocation failed!\n");
+        exit(1);
+    }
+    if (array) {
+        memcpy(data, array -> data, count * size);
+        shared_release(array);
+    }
+    return shared_wrap(data, false);
+}
+
+void shared_release(SharedArray* array) {
+    if (!array) return;
+    if (SDL_AtomicAdd(&array -> refs, -1) != 1) return;
+    if (!array -> mapped) free(array -> data);
+    free(array);
+}
+
+static SharedArray* shared_retain(SharedArray* array) {
+    if (array) SDL_AtomicIncRef(&array -> refs);
+    return array;
+}
+
+Snapshot* snapshot_take(SharedArray* point_store, size_t point_count, SharedArray* stroke_store, size_t stroke_count, const char* text, size_t text_len, Uint32 board) {
+    Snapshot* snapshot = malloc(sizeof(Snapshot));
+    char* text_copy = malloc(text_len + 1);
+    if (!snapshot || !text_copy) {
+        fprintf(stderr, "Memory allocation failed!\n");
+        exit(1);
+    }
+    if (text_len) memcpy(text_copy, text, text_len);
+    text_copy[text_len] = '\0';
+
+    SDL_AtomicSet(&snapshot -> refs, 1);
+    snapshot -> version = (Uint64) SDL_AtomicAdd(&next_version, 1) + 1;
+    snapshot -> board = board;
+
+    snapshot -> point_store = point_count ? shared_retain(point_store) : NULL;
+    snapshot -> points = point_count ? point_store -> data : NULL;
+    snapshot -> point_count = point_count;
+
+    snapshot -> stroke_store = stroke_count ? shared_retain(stroke_store) : NULL;
+    snapshot -> strokes = stroke_count ? stroke_store -> data : NULL;
+    snapshot -> stroke_count = stroke_count;
+    if (stroke_count) snapshot -> live = snapshot -> strokes[stroke_count - 1];
+
+    snapshot -> text = text_copy;
+    snapshot -> text_len = text_len;
+    return snapshot;
+}
+
+Snapshot* snapshot_retain(Snapshot* snapshot) {
+    SDL_AtomicIncRef(&snapshot -> refs);
+    return snapshot;
+}
+
+void snapshot_release(Snapshot* snapshot) {
+    if (!snapshot) return;
+    if (SDL_AtomicAdd(&snapshot -> refs, -1) != 1) return;
+    shared_release(snapshot -> point_store);
+    shared_release(snapshot -> stroke_store);
+    free(snapshot -> text);
+    free(snapshot);
+}
+
+typedef struct {
+    Snapshot* snapshot;
+    SnapshotTask task;
+    void* data;
+} TaskStart;
+
+static void task_job(void* data) {
+    TaskStart* start = data;
+    start -> task(start -> snapshot, start -> data);
+    snapshot_drop(start -> snapshot);
+    free(start -> data);
+    free(start);
+}
+
+Snapshot* snapshot_hold(Snapshot* snapshot) {
+    SDL_LockMutex(task_lock);
+    tasks_running++;
+    SDL_UnlockMutex(task_lock);
+    return snapshot_retain(snapshot);
+}
+
+void snapshot_drop(Snapshot* snapshot) {
+    snapshot_release(snapshot);
+
+    SDL_LockMutex(task_lock);
+    tasks_running--;
+    SDL_CondBroadcast(task_done);
+    SDL_UnlockMutex(task_lock);
+}
+
+bool snapshot_init(void) {
+    task_lock = SDL_CreateMutex();
+    task_done = SDL_CreateCond();
+    if (!task_lock || !task_done) {
+        printf("Couldn't create task lock: %s\n", SDL_GetError());
+        return false;
+    }
+    return true;
+}
+
+bool snapshot_run(const char* name, Snapshot* snapshot, SnapshotTask task, void* data) {
+    TaskStart* start = malloc(sizeof(TaskStart));
+    if (!start) {
+        fprintf(stderr, "Memory allocation failed!\n");
+        exit(1);
+    }
+    *start = (TaskStart) {snapshot_hold(snapshot), task, data};
+
+    job_submit(job_create(name, JOB_NORMAL, task_job, NULL, start));
+    return true;
+}
+
+void snapshot_shutdown(void) {
+    SDL_LockMutex(task_lock);
+    while (tasks_running > 0) SDL_CondWait(task_done, task_lock);
+    SDL_UnlockMutex(task_lock);
+
+    SDL_DestroyCond(task_done);
+    SDL_DestroyMutex(task_lock);
+    task_lock = NULL;
+    task_done = NULL;
+}
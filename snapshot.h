@@ -0,0 +1,65 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <SDL2/SDL.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "__struct.h"
+
+// Reference counted storage behind the points and the stroke table. The input
+// path only ever writes past what a snapshot can see (new points, the live
+// stroke), so shared elements never change underneath a reader and nobody locks.
+typedef struct {
+    SDL_atomic_t refs;
+    void* data;
+    bool mapped; // data belongs to the open document's mapping, never freed here
+} SharedArray;
+
+SharedArray* shared_wrap(void* data, bool mapped);
+// Room for capacity elements, keeping the first count. Reallocates in place while
+// nobody else holds the array, otherwise continues in a fresh copy.
+SharedArray* shared_grow(SharedArray* array, size_t count, size_t capacity, size_t size);
+void shared_release(SharedArray* array);
+
+// Frozen view of the board. Points and finished strokes are shared by reference;
+// only the live stroke and the text are copied.
+typedef struct {
+    SDL_atomic_t refs;
+    Uint64 version; // Increases with every snapshot taken
+    Uint32 board; // Board generation it was taken from, see RenderView.board
+
+    SharedArray* point_store;
+    const Point* points;
+    size_t point_count;
+
+    SharedArray* stroke_store;
+    const Stroke* strokes; // Valid for [0, stroke_count - 1), the last one is live
+    size_t stroke_count;
+    Stroke live;
+
+    char* text;
+    size_t text_len;
+} Snapshot;
+
+// Constant time apart from the text copy; call from the thread that edits the board
+Snapshot* snapshot_take(SharedArray* point_store, size_t point_count, SharedArray* stroke_store, size_t stroke_count, const char* text, size_t text_len, Uint32 board);
+Snapshot* snapshot_retain(Snapshot* snapshot);
+void snapshot_release(Snapshot* snapshot);
+
+static inline const Stroke* snapshot_stroke(const Snapshot* snapshot, size_t i) {
+    return i + 1 == snapshot -> stroke_count ? &snapshot -> live : &snapshot -> strokes[i];
+}
+
+// Runs task(snapshot, data) as a job, then releases the snapshot and frees data
+typedef void (*SnapshotTask)(Snapshot* snapshot, void* data);
+bool snapshot_init(void);
+bool snapshot_run(const char* name, Snapshot* snapshot, SnapshotTask task, void* data);
+// For a task that hands the snapshot on to jobs of its own: keeps it, and
+// snapshot_shutdown waiting, until the matching snapshot_drop
+Snapshot* snapshot_hold(Snapshot* snapshot);
+void snapshot_drop(Snapshot* snapshot);
+// Waits for every task; mapped arrays must outlive them
+void snapshot_shutdown(void);
+
+#endif
@@ -0,0 +1,336 @@
+#include <SDL2/SDL.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "__macros.h"
+#include "export.h"
+#include "vector.h"
+
+// Output goes through one big buffer; offset counts every byte for the PDF xref
+typedef struct {
+    FILE* fp;
+    char buffer[VECTOR_BUFFER_SIZE];
+    size_t used;
+    long long offset;
+    bool failed;
+} Writer;
+
+static void flush(Writer* out) {
+    if (out -> used && fwrite(out -> buffer, 1, out -> used, out -> fp) != out -> used) {
+        out -> failed = true;
+    }
+    out -> used = 0;
+}
+
+static void put(Writer* out, const char* data, size_t len) {
+    if (out -> used + len > sizeof(out -> buffer)) flush(out);
+    if (len > sizeof(out -> buffer)) {
+        if (fwrite(data, 1, len, out -> fp) != len) out -> failed = true;
+    } else {
+        memcpy(out -> buffer + out -> used, data, len);
+        out -> used += len;
+    }
+    out -> offset += len;
+}
+
+static void putf(Writer* out, const char* fmt, ...) {
+    char text[256];
+    va_list args;
+    va_start(args, fmt);
+    int len = vsnprintf(text, sizeof(text), fmt, args);
+    va_end(args);
+    if (len > 0) put(out, text, (size_t) len < sizeof(text) ? (size_t) len : sizeof(text) - 1);
+}
+
+#define put_literal(out, text) put(out, text, sizeof(text) - 1)
+
+// Coordinates are the bulk of the file, so skip printf for them
+static void put_int(Writer* out, long long value) {
+    char text[24];
+    int i = sizeof(text);
+    bool negative = value < 0;
+    unsigned long long magnitude = negative ? -(unsigned long long) value : (unsigned long long) value;
+    do {
+        text[--i] = '0' + magnitude % 10;
+        magnitude /= 10;
+    } while (magnitude);
+    if (negative) text[--i] = '-';
+    put(out, text + i, sizeof(text) - i);
+}
+
+// Overwrites bytes that were already written, used for headers whose values are only known at the end
+static void patch(Writer* out, long long offset, const char* data, size_t len) {
+    flush(out);
+    if (fseek(out -> fp, offset, SEEK_SET) != 0 || fwrite(data, 1, len, out -> fp) != len || fseek(out -> fp, 0, SEEK_END) != 0) {
+        out -> failed = true;
+    }
+}
+
+typedef struct {
+    long long max_x, max_y;
+} Bounds;
+
+static void grow(Bounds* bounds, const Point* p) {
+    long long reach = p -> line_thickness / 2 + 1;
+    if (p -> x + reach > bounds -> max_x) bounds -> max_x = p -> x + reach;
+    if (p -> y + reach > bounds -> max_y) bounds -> max_y = p -> y + reach;
+}
+
+// Calls the format's callbacks for every run of drawable segments with one thickness,
+// the same segments RenderPoint draws
+typedef struct {
+    void (*begin)(Writer* out, const Point* p);
+    void (*next)(Writer* out, const Point* p);
+    void (*end)(Writer* out);
+} PathWriter;
+
+static void walk_strokes(Writer* out, const VectorExport* job, const PathWriter* path, Bounds* bounds) {
+    bool open = false;
+    long long thickness = 0;
+
+    for (size_t i = 0; i + 1 < job -> point_count; i++) {
+        const Point* p1 = &job -> points[i];
+        const Point* p2 = &job -> points[i + 1];
+
+        if (!(p1 -> connect && p2 -> connect)) {
+            if (open) path -> end(out);
+            open = false;
+            continue;
+        }
+
+        if (!open || p1 -> line_thickness != thickness) {
+            if (open) path -> end(out);
+            path -> begin(out, p1);
+            grow(bounds, p1);
+            thickness = p1 -> line_thickness;
+            open = true;
+        }
+        path -> next(out, p2);
+        grow(bounds, p2);
+    }
+    if (open) path -> end(out);
+}
+
+/* SVG */
+
+static void svg_begin(Writer* out, const Point* p) {
+    put_literal(out, "<path stroke-width=\"");
+    put_int(out, p -> line_thickness);
+    put_literal(out, "\" d=\"M");
+    put_int(out, p -> x);
+    put_literal(out, " ");
+    put_int(out, p -> y);
+    put_literal(out, "L");
+}
+
+static void svg_next(Writer* out, const Point* p) {
+    put_int(out, p -> x);
+    put_literal(out, " ");
+    put_int(out, p -> y);
+    put_literal(out, " ");
+}
+
+static void svg_end(Writer* out) {
+    put_literal(out, "\"/>\n");
+}
+
+static void svg_text(Writer* out, const VectorExport* job) {
+    if (!job -> text || !job -> text[0]) return;
+
+    putf(out, "<g font-family=\"Coming Soon\" font-size=\"%d\" fill=\"#%02x%02x%02x\" xml:space=\"preserve\">\n", job -> font_size, job -> foreground.r, job -> foreground.g, job -> foreground.b);
+
+    const char* line = job -> text;
+    for (int row = 0; ; row++) {
+        const char* line_end = strchr(line, '\n');
+        size_t len = line_end ? (size_t) (line_end - line) : strlen(line);
+
+        putf(out, "<text x=\"%d\" y=\"%d\">", job -> text_x, job -> text_y + job -> font_size + row * job -> line_height);
+        for (size_t i = 0; i < len; i++) {
+            switch (line[i]) {
+                case '<': put_literal(out, "&lt;"); break;
+                case '>': put_literal(out, "&gt;"); break;
+                case '&': put_literal(out, "&amp;"); break;
+                case '\t': put_literal(out, "    "); break;
+                default: put(out, &line[i], 1); break;
+            }
+        }
+        put_literal(out, "</text>\n");
+
+        if (!line_end) break;
+        line = line_end + 1;
+    }
+    put_literal(out, "</g>\n");
+}
+
+static void write_svg(Writer* out, const VectorExport* job) {
+    put_literal(out, "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n<svg xmlns=\"http://www.w3.org/2000/svg\"");
+
+    // Size is patched in once every point has been seen
+    long long size_offset = out -> offset;
+    char size[VECTOR_SIZE_FIELD + 1];
+    memset(size, ' ', VECTOR_SIZE_FIELD);
+    put(out, size, VECTOR_SIZE_FIELD);
+    put_literal(out, ">\n");
+
+    putf(out, "<rect width=\"100%%\" height=\"100%%\" fill=\"#%02x%02x%02x\"/>\n", job -> background.r, job -> background.g, job -> background.b);
+    putf(out, "<g fill=\"none\" stroke=\"#%02x%02x%02x\" stroke-linecap=\"round\" stroke-linejoin=\"round\">\n", job -> foreground.r, job -> foreground.g, job -> foreground.b);
+
+    Bounds bounds = {RENDER_WINDOW_WIDTH, RENDER_WINDOW_HEIGHT};
+    PathWriter path = {svg_begin, svg_next, svg_end};
+    walk_strokes(out, job, &path, &bounds);
+    put_literal(out, "</g>\n");
+
+    svg_text(out, job);
+    put_literal(out, "</svg>\n");
+
+    int len = snprintf(size, sizeof(size), " width=\"%lld\" height=\"%lld\" viewBox=\"0 0 %lld %lld\"", bounds.max_x, bounds.max_y, bounds.max_x, bounds.max_y);
+    if (len > 0 && len < VECTOR_SIZE_FIELD) size[len] = ' ';
+    patch(out, size_offset, size, VECTOR_SIZE_FIELD);
+}
+
+/* PDF */
+
+static void pdf_begin(Writer* out, const Point* p) {
+    put_int(out, p -> line_thickness);
+    put_literal(out, " w\n");
+    put_int(out, p -> x);
+    put_literal(out, " ");
+    put_int(out, p -> y);
+    put_literal(out, " m\n");
+}
+
+static void pdf_next(Writer* out, const Point* p) {
+    put_int(out, p -> x);
+    put_literal(out, " ");
+    put_int(out, p -> y);
+    put_literal(out, " l\n");
+}
+
+static void pdf_end(Writer* out) {
+    put_literal(out, "S\n");
+}
+
+// Text uses the built in Helvetica, PDF viewers don't have Coming Soon
+static void pdf_text(Writer* out, const VectorExport* job) {
+    if (!job -> text || !job -> text[0]) return;
+
+    putf(out, "BT\n/F1 %d Tf\n", job -> font_size);
+    const char* line = job -> text;
+    for (int row = 0; ; row++) {
+        const char* line_end = strchr(line, '\n');
+        size_t len = line_end ? (size_t) (line_end - line) : strlen(line);
+
+        // Flip the glyphs back upright inside the flipped page
+        putf(out, "1 0 0 -1 %d %d Tm\n(", job -> text_x, job -> text_y + job -> font_size + row * job -> line_height);
+        for (size_t i = 0; i < len; i++) {
+            char c = line[i];
+            if (c == '(' || c == ')' || c == '\\') put_literal(out, "\\");
+            if (c == '\t') {
+                put_literal(out, "    ");
+            } else if ((unsigned char) c >= 0x20 && (unsigned char) c < 0x7F) {
+                put(out, &c, 1);
+            }
+        }
+        put_literal(out, ") Tj\n");
+
+        if (!line_end) break;
+        line = line_end + 1;
+    }
+    put_literal(out, "ET\n");
+}
+
+static void write_pdf(Writer* out, const VectorExport* job) {
+    // Objects: 1 catalog, 2 pages, 3 page, 4 content stream, 5 its length, 6 font.
+    // The stream goes first so the page box can use the bounds found while streaming.
+    long long objects[7] = {0};
+
+    put_literal(out, "%PDF-1.4\n%\xE2\xE3\xCF\xD3\n");
+
+    objects[4] = out -> offset;
+    put_literal(out, "4 0 obj\n<< /Length 5 0 R >>\nstream\n");
+    long long stream_start = out -> offset;
+
+    // The page box is [0 -height width 0], so flipping y keeps window coordinates
+    putf(out, "1 0 0 -1 0 0 cm\n%.3f %.3f %.3f rg\n0 0 %d %d re f\n", job -> background.r / 255.0, job -> background.g / 255.0, job -> background.b / 255.0, EXPORT_MAX_SIZE, EXPORT_MAX_SIZE);
+    putf(out, "%.3f %.3f %.3f RG\n1 J\n1 j\n", job -> foreground.r / 255.0, job -> foreground.g / 255.0, job -> foreground.b / 255.0);
+
+    Bounds bounds = {RENDER_WINDOW_WIDTH, RENDER_WINDOW_HEIGHT};
+    PathWriter path = {pdf_begin, pdf_next, pdf_end};
+    walk_strokes(out, job, &path, &bounds);
+
+    putf(out, "%.3f %.3f %.3f rg\n", job -> foreground.r / 255.0, job -> foreground.g / 255.0, job -> foreground.b / 255.0);
+    pdf_text(out, job);
+
+    long long stream_length = out -> offset - stream_start;
+    put_literal(out, "endstream\nendobj\n");
+
+    objects[5] = out -> offset;
+    putf(out, "5 0 obj\n%lld\nendobj\n", stream_length);
+
+    objects[6] = out -> offset;
+    putf(out, "6 0 obj\n<< /Type /Font /Subtype /Type1 /BaseFont /Helvetica >>\nendobj\n");
+
+    objects[3] = out -> offset;
+    putf(out, "3 0 obj\n<< /Type /Page /Parent 2 0 R /MediaBox [0 %lld %lld 0] /Contents 4 0 R /Resources << /Font << /F1 6 0 R >> >> >>\nendobj\n", -bounds.max_y, bounds.max_x);
+
+    objects[2] = out -> offset;
+    putf(out, "2 0 obj\n<< /Type /Pages /Kids [3 0 R] /Count 1 >>\nendobj\n");
+
+    objects[1] = out -> offset;
+    putf(out, "1 0 obj\n<< /Type /Catalog /Pages 2 0 R >>\nendobj\n");
+
+    long long xref = out -> offset;
+    putf(out, "xref\n0 7\n0000000000 65535 f \n");
+    for (int i = 1; i <= 6; i++) {
+        putf(out, "%010lld 00000 n \n", objects[i]);
+    }
+    putf(out, "trailer\n<< /Size 7 /Root 1 0 R >>\nstartxref\n%lld\n%%%%EOF\n", xref);
+}
+
+bool ExportVector(const VectorExport* job, VectorFormat format) {
+    char filename[256];
+    int fd = export_reserve("__drawing__", format == VECTOR_PDF ? "pdf" : "svg", filename, sizeof(filename));
+    if (fd < 0) {
+        export_notify(-1, NULL);
+        return false;
+    }
+
+    Writer* out = malloc(sizeof(Writer));
+    FILE* fp = out ? fdopen(fd, "wb") : NULL;
+    if (!fp) {
+        close(fd);
+        unlink(filename);
+        free(out);
+        export_notify(-1, filename);
+        return false;
+    }
+    setvbuf(fp, NULL, _IONBF, 0); // Writer already buffers
+
+    out -> fp = fp;
+    out -> used = 0;
+    out -> offset = 0;
+    out -> failed = false;
+
+    if (format == VECTOR_PDF) {
+        write_pdf(out, job);
+    } else {
+        write_svg(out, job);
+    }
+    flush(out);
+
+    bool saved = !out -> failed;
+    if (fclose(fp) != 0) saved = false;
+    free(out);
+
+    if (!saved) {
+        printf("Unable to save vector export\n");
+        unlink(filename);
+    }
+    export_notify(saved ? 0 : -1, filename);
+    return saved;
+}
@@ -0,0 +1,29 @@
+#ifndef VECTOR_H
+#define VECTOR_H
+
+#include <SDL2/SDL.h>
+#include <stdbool.h>
+
+#include "__struct.h"
+
+typedef enum {
+    VECTOR_SVG,
+    VECTOR_PDF,
+} VectorFormat;
+
+typedef struct {
+    const Point* points;
+    size_t point_count;
+    const char* text; // May be NULL
+    int font_size, line_height;
+    int text_x, text_y;
+    SDL_Color foreground, background;
+} VectorExport;
+
+// Walks the points once and streams one path per stroke (and one text line per
+// line of text) through a buffered writer. Nothing is built up in memory, so the
+// file grows with the number of points, not with the canvas size.
+// Reported through EXPORT_EVENT.
+bool ExportVector(const VectorExport* job, VectorFormat format);
+
+#endif
@@ -0,0 +1,175 @@
+// Synthetic workload generator: deterministic documents of any size for make
+// bench and scaling tests. The same options and seed always give the same file.
+//
+//   make workload
+//   ./scratch_workload [options] [--csv out.csv] [--scratch out.scratch]
+//
+//   --seed N            Random seed (1)
+//   --strokes N         Number of strokes (1000)
+//   --length N          Points per stroke (100)
+//   --distribution D    uniform: stroke starts anywhere on the area
+//                       clustered: around a few centres, like notes and sketches
+//   --width N --height N   Area covered, strokes bounce off its edges
+//                       (RENDER_WINDOW_WIDTH x RENDER_WINDOW_HEIGHT)
+//   --thickness LIST    Comma separated thicknesses picked from at random, repeat
+//                       one to weight it (2,2,2,3,8)
+//   --text N            Bytes of typed text (0)
+//
+// Points go through addPoint like real input, so thresholds and strokes match a
+// drawn board. 10M points are --strokes 100000 --length 100.
+
+#define SCRATCH_BENCH
+#include "main.c"
+
+#include <math.h>
+
+static Uint64 rng_state;
+
+// xorshift64*, fixed so outputs don't depend on the C library
+static Uint64 next_random(void) {
+    rng_state ^= rng_state >> 12;
+    rng_state ^= rng_state << 25;
+    rng_state ^= rng_state >> 27;
+    return rng_state * 2685821657736338717ull;
+}
+
+static double random_unit(void) {
+    return (next_random() >> 11) * (1.0 / 9007199254740992.0);
+}
+
+static double random_normal(void) {
+    double u = random_unit(), v = random_unit();
+    return sqrt(-2 * log(u > 0 ? u : 1e-12)) * cos(2 * M_PI * v);
+}
+
+// Folds a coordinate back into [0, size), returns true if it bounced
+static bool reflect(double* value, int size) {
+    bool bounced = false;
+    if (*value < 0) {
+        *value = -*value;
+        bounced = true;
+    }
+    if (*value > size - 1) {
+        *value = 2.0 * (size - 1) - *value;
+        bounced = true;
+    }
+    // A step longer than the area itself
+    if (*value < 0) *value = 0;
+    return bounced;
+}
+
+static int parse_thicknesses(const char* list, int* thicknesses) {
+    int count = 0;
+    for (const char* p = list; *p && count < WORKLOAD_MAX_THICKNESSES; ) {
+        char* end;
+        long value = strtol(p, &end, 10);
+        if (end == p) break;
+        if (value > 0) thicknesses[count++] = value;
+        p = *end == ',' ? end + 1 : end;
+    }
+    return count;
+}
+
+int main(int argc, char** argv) {
+    Uint64 seed = 1;
+    long stroke_total = 1000, length = 100, text = 0;
+    int width = RENDER_WINDOW_WIDTH, height = RENDER_WINDOW_HEIGHT;
+    bool clustered = false;
+    int thicknesses[WORKLOAD_MAX_THICKNESSES] = {2, 2, 2, 3, 8};
+    int thickness_count = 5;
+    const char *csv_path = NULL, *scratch_path = NULL;
+
+    for (int i = 1; i + 1 < argc; i += 2) {
+        const char *option = argv[i], *value = argv[i + 1];
+        if (strcmp(option, "--seed") == 0) seed = strtoull(value, NULL, 10);
+        else if (strcmp(option, "--strokes") == 0) stroke_total = atol(value);
+        else if (strcmp(option, "--length") == 0) length = atol(value);
+        else if (strcmp(option, "--width") == 0) width = atoi(value);
+        else if (strcmp(option, "--height") == 0) height = atoi(value);
+        else if (strcmp(option, "--text") == 0) text = atol(value);
+        else if (strcmp(option, "--csv") == 0) csv_path = value;
+        else if (strcmp(option, "--scratch") == 0) scratch_path = value;
+        else if (strcmp(option, "--distribution") == 0) clustered = strcmp(value, "clustered") == 0;
+        else if (strcmp(option, "--thickness") == 0) thickness_count = parse_thicknesses(value, thicknesses);
+        else {
+            printf("Unknown option %s\n", option);
+            return 1;
+        }
+    }
+    if (!csv_path && !scratch_path) {
+        printf("Nothing to write: pass --csv and/or --scratch\n");
+        return 1;
+    }
+    if (stroke_total < 0 || length < 2 || width < 1 || height < 1 || thickness_count == 0) {
+        printf("Invalid workload\n");
+        return 1;
+    }
+    rng_state = seed ? seed : 1;
+    document_init();
+
+    double centres[WORKLOAD_CLUSTERS][2];
+    for (int c = 0; c < WORKLOAD_CLUSTERS; c++) {
+        centres[c][0] = random_unit() * width;
+        centres[c][1] = random_unit() * height;
+    }
+
+    for (long s = 0; s < stroke_total; s++) {
+        double x, y;
+        if (clustered) {
+            const double* centre = centres[next_random() % WORKLOAD_CLUSTERS];
+            x = centre[0] + random_normal() * width / 16;
+            y = centre[1] + random_normal() * height / 16;
+            reflect(&x, width);
+            reflect(&y, height);
+        } else {
+            x = random_unit() * width;
+            y = random_unit() * height;
+        }
+        int thickness = thicknesses[next_random() % thickness_count];
+
+        // Pen moving in gentle curves, a few px per sample like mouse input
+        double heading = random_unit() * 2 * M_PI, turn = 0;
+        for (long i = 0; i < length; i++) {
+            addPoint(lround(x), lround(y), thickness, true);
+            turn = turn * 0.9 + (random_unit() - 0.5) * 0.2;
+            heading += turn;
+            double step = 2 + random_unit() * 4;
+            x += cos(heading) * step;
+            y += sin(heading) * step;
+            if (reflect(&x, width)) heading = M_PI - heading;
+            if (reflect(&y, height)) heading = -heading;
+        }
+        addPoint(lround(x), lround(y), thickness, false); // Button up
+    }
+
+    // Words of 2-9 letters, separated by a space or now and then a newline
+    long word = 2 + next_random() % 8;
+    for (long i = 0; i < text; i++) {
+        Uint64 r = next_random();
+        char c;
+        if (word > 0) {
+            c = 'a' + (char) ((r >> 8) % 26);
+            word--;
+        } else {
+            c = r % 12 == 0 ? '\n' : ' ';
+            word = 2 + (r >> 8) % 8;
+        }
+        add_user_input(c);
+    }
+
+    bool ok = true;
+    if (csv_path) {
+        ok = SaveCSV(csv_path, points, pointCount) && ok;
+    }
+    if (scratch_path) {
+        Snapshot* snapshot = snapshotBoard();
+        ok = document_save(scratch_path, snapshot) && ok;
+        snapshot_release(snapshot);
+    }
+    printf("%zu points, %zu strokes, %zu bytes of text\n", pointCount, strokeCount, usr_inputs_len);
+
+    clearPoints();
+    free(usr_inputs);
+    document_shutdown();
+    return ok ? 0 : 1;
+}